@@ -0,0 +1,55 @@
+/// AFL++ custom mutator around mutfuzz.cpp
+///
+/// Built as shared library together with generated fuzzer.cpp and class sources:
+///   c++ -shared -fPIC -I. aflmut.cpp <class sources> -o cfuzz_mutator.so
+///   AFL_CUSTOM_MUTATOR_LIBRARY=./cfuzz_mutator.so afl-fuzz ...
+
+#define CFUZZ_NO_ENTRY
+// there is no libFuzzer here, so byte level mutation for arguments is stub of cfuzz.hpp
+#define CFUZZ_MUTATE_STUB
+#include "mutfuzz.cpp"
+
+#include <cstdlib>
+
+struct AflMutator {
+    std::mt19937 rng;
+    uint8_t *buf;
+    size_t cap;
+};
+
+extern "C" void *afl_custom_init(void *afl, unsigned int seed) {
+    AflMutator *m = new AflMutator;
+    m->rng.seed(seed);
+    cfuzz::stub_seed(seed);
+    m->buf = nullptr;
+    m->cap = 0;
+    return m;
+}
+
+extern "C" size_t afl_custom_fuzz(
+    void *data,
+    uint8_t *buf, size_t buf_size,
+    uint8_t **out_buf,
+    uint8_t *add_buf, size_t add_buf_size,
+    size_t max_size
+) {
+    AflMutator *m = (AflMutator *)data;
+    if (m->cap < max_size) {
+        m->buf = (uint8_t *)realloc(m->buf, max_size);
+        m->cap = max_size;
+    }
+
+    // libFuzzer mutator works in place, AFL++ wants output in our buffer
+    if (buf_size > max_size)
+        buf_size = max_size;
+    memcpy(m->buf, buf, buf_size);
+
+    *out_buf = m->buf;
+    return LLVMFuzzerCustomMutator(m->buf, buf_size, max_size, m->rng());
+}
+
+extern "C" void afl_custom_deinit(void *data) {
+    AflMutator *m = (AflMutator *)data;
+    free(m->buf);
+    delete m;
+}
@@ -0,0 +1,1409 @@
+/// Runtime support for harnesses generated by main.c
+///
+/// Wire format, budget and canonical form are always there. Other sections are
+/// switched by macros and expand to nothing when off: CFUZZ_DIFF and CFUZZ_CONCURRENT
+/// are defined by harnesses generated with --diff and --concurrent, the rest are
+/// build options (see README). Needs C++20.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator> // for std::size
+#include <type_traits>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+///////////////////////////// COMMON /////////////////////////////
+
+namespace cfuzz {
+
+enum CallKind { CALL_CONSTR, CALL_METHOD };
+
+// Object of chain of static calls
+struct NoObject {};
+
+// Defined by generated harness
+const char *call_name(CallKind kind, size_t id);
+size_t call_arg_size(CallKind kind, size_t id);
+
+// Cycles on x86, steady_clock ticks elsewhere
+inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Minimal buffered writer, only async-signal-safe calls inside
+struct Out {
+    int fd;
+    size_t n;
+    char buf[4096];
+
+    void flush() {
+        for (size_t done = 0; done < n;) {
+            ssize_t w = write(fd, buf + done, n - done);
+            if (w <= 0)
+                break;
+            done += w;
+        }
+        n = 0;
+    }
+
+    void put(const char *s) {
+        for (; *s; ++s) {
+            if (n == sizeof(buf))
+                flush();
+            buf[n++] = *s;
+        }
+    }
+
+    void num(uint64_t v) {
+        char tmp[24];
+        size_t i = sizeof(tmp);
+        tmp[--i] = '\0';
+        do {
+            tmp[--i] = '0' + v % 10;
+            v /= 10;
+        } while (v);
+        put(tmp + i);
+    }
+
+    void hex(uint8_t v) {
+        const char digits[] = "0123456789abcdef";
+        const char tmp[3] = {digits[v >> 4], digits[v & 15], '\0'};
+        put(tmp);
+    }
+};
+
+} // namespace cfuzz
+
+///////////////////////////// BUDGET /////////////////////////////
+
+// Per-exec limits on method calls and cycles, so long chains can't drag throughput down.
+// Defaults come from macros and can be overridden by environment variables
+// of the same name, 0 means no limit. Call limit is also honoured by mutfuzz.cpp.
+
+#ifndef CFUZZ_CALL_LIMIT
+#define CFUZZ_CALL_LIMIT 1024
+#endif
+
+#ifndef CFUZZ_CYCLE_LIMIT
+#define CFUZZ_CYCLE_LIMIT 0
+#endif
+
+namespace cfuzz {
+
+// Checked every this many calls, so timer isn't read on each
+constexpr size_t BUDGET_CYCLE_STRIDE = 16;
+
+inline size_t budget_env(const char *name, size_t fallback) {
+    const char *v = getenv(name);
+    return v ? strtoull(v, nullptr, 0) : fallback;
+}
+
+inline size_t call_limit = budget_env("CFUZZ_CALL_LIMIT", CFUZZ_CALL_LIMIT);
+inline uint64_t cycle_limit = budget_env("CFUZZ_CYCLE_LIMIT", CFUZZ_CYCLE_LIMIT);
+
+// shared by threads running chains (distill.cpp), so they are atomic
+inline std::atomic<size_t> budget_execs{0};
+inline std::atomic<size_t> budget_call_hits{0};
+inline std::atomic<size_t> budget_cycle_hits{0};
+inline std::atomic<size_t> budget_mutator_hits{0};
+
+inline void budget_report() {
+    const size_t call_hits = budget_call_hits.load(std::memory_order_relaxed);
+    const size_t cycle_hits = budget_cycle_hits.load(std::memory_order_relaxed);
+    const size_t mutator_hits = budget_mutator_hits.load(std::memory_order_relaxed);
+    if (call_hits || cycle_hits || mutator_hits)
+        fprintf(stderr,
+            "==cfuzz== budget: %zu execs, call limit (%zu) hit %zu times, cycle limit (%llu) hit %zu times, "
+            "%zu mutations kept from growing chain\n",
+            budget_execs.load(std::memory_order_relaxed), call_limit, call_hits, (unsigned long long)cycle_limit,
+            cycle_hits, mutator_hits);
+}
+
+inline const bool budget_registered = atexit(budget_report) == 0;
+
+// Returns exec start, 0 if cycles aren't limited
+inline uint64_t budget_begin() {
+    budget_execs.fetch_add(1, std::memory_order_relaxed);
+    return cycle_limit ? now() : 0;
+}
+
+// True if method call number `calls` (from 0) doesn't fit into budget
+inline bool budget_over(size_t calls, uint64_t start) {
+    if (call_limit && calls >= call_limit) {
+        budget_call_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (cycle_limit && calls % BUDGET_CYCLE_STRIDE == 0 && now() - start > cycle_limit) {
+        budget_cycle_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+} // namespace cfuzz
+
+///////////////////////////// WIRE FORMAT /////////////////////////////
+
+// Chain is constructor call followed by method calls, each call is id byte and argument bytes.
+// Interleaved (default): argument bytes follow id byte of their call.
+// Split (main.c --split): id bytes are read from front and argument bytes from back,
+// first call takes last bytes. Inserting or erasing bytes in one stream doesn't move
+// calls of the other, so generic byte mutations keep chain structure.
+// Decoding stops at first call that doesn't fit, leftover bytes are ignored.
+
+namespace cfuzz {
+
+struct Call {
+    size_t op;  // offset of id byte
+    size_t id;  // id in list
+    size_t args;  // offset of argument bytes
+    size_t arg_size;
+};
+
+// Shared by harness, canonical form and mutator
+template <bool split>
+struct ChainReader {
+    const uint8_t *data;
+    size_t front;  // next id byte
+    size_t back;  // end of argument bytes left (end of data in interleaved chain)
+
+    ChainReader(const uint8_t *data, size_t size) : data(data), front(0), back(size) {}
+
+    // Next call of list, false if it doesn't fit
+    template <const auto &list>
+    bool next(Call &call) {
+        if (front >= back)
+            return false;
+        call.op = front;
+        call.id = data[front] % std::size(list);
+        call.arg_size = list[call.id].arg_size;
+        if (front + 1 + call.arg_size > back)
+            return false;
+
+        if constexpr (split) {
+            back -= call.arg_size;
+            call.args = back;
+            front += 1;
+        } else {
+            call.args = front + 1;
+            front += 1 + call.arg_size;
+        }
+        return true;
+    }
+};
+
+// Same calls in other format (out has size bytes, it can't be in), leftover bytes go after calls
+template <const auto &constr_list, const auto &method_list, bool split>
+void convert_chain(const uint8_t *in, size_t size, uint8_t *out) {
+    ChainReader<split> chain(in, size);
+    size_t front = 0, back = size;
+    Call call;
+    for (bool ok = chain.template next<constr_list>(call); ok; ok = chain.template next<method_list>(call)) {
+        out[front] = in[call.op];
+        if constexpr (split) {
+            // to interleaved
+            memcpy(out + front + 1, in + call.args, call.arg_size);
+            front += 1 + call.arg_size;
+        } else {
+            back -= call.arg_size;
+            memcpy(out + back, in + call.args, call.arg_size);
+            front += 1;
+        }
+    }
+    memcpy(out + front, in + chain.front, chain.back - chain.front);
+}
+
+template <const auto &constr_list, const auto &method_list>
+void split_to_interleaved(const uint8_t *in, size_t size, uint8_t *out) {
+    convert_chain<constr_list, method_list, true>(in, size, out);
+}
+
+template <const auto &constr_list, const auto &method_list>
+void interleaved_to_split(const uint8_t *in, size_t size, uint8_t *out) {
+    convert_chain<constr_list, method_list, false>(in, size, out);
+}
+
+} // namespace cfuzz
+
+///////////////////////////// CANONICAL FORM /////////////////////////////
+
+// Many inputs run same calls: ids are taken modulo list size, trailing partial call
+// and calls past call limit are ignored, repeated argumentless pure calls are skipped
+// with CFUZZ_SKIP_PURE. Canonical form keeps only what harness executes, with exact ids.
+
+namespace cfuzz {
+
+// Const methods with mutable members or global side effects aren't pure in fact,
+// so skipping their repeated calls is opt-in
+#ifdef CFUZZ_SKIP_PURE
+inline constexpr bool skip_pure_calls = true;
+#else
+inline constexpr bool skip_pure_calls = false;
+#endif
+
+// Rewrite chain of one class in place, returns new size (0 if nothing would be called).
+// Pure calls are kept when harness doesn't skip them (concurrent mode)
+template <const auto &constr_list, const auto &method_list, bool split = false, bool skip_pure = skip_pure_calls>
+size_t canonical_chain(uint8_t *data, size_t size) {
+    constexpr size_t constr_size = std::size(constr_list);
+    constexpr size_t method_size = std::size(method_list);
+
+    if (size == 0)
+        return 0;
+
+    // split chain is canonicalized interleaved
+    if constexpr (split) {
+        uint8_t *tmp = (uint8_t *)malloc(size);
+        split_to_interleaved<constr_list, method_list>(data, size, tmp);
+        size = canonical_chain<constr_list, method_list, false, skip_pure>(tmp, size);
+        interleaved_to_split<constr_list, method_list>(tmp, size, data);
+        free(tmp);
+        return size;
+    }
+    size_t id = data[0] % constr_size;
+    const size_t constr_end = 1 + constr_list[id].arg_size;
+    if (constr_end > size)
+        return 0;
+    data[0] = id;
+
+    // same skipping as in run_chain of harness
+    uint64_t pure_seen = 0;
+    size_t in = constr_end, out = constr_end, calls = 0;
+    while (in < size && !(call_limit && calls >= call_limit)) {
+        id = data[in] % method_size;
+        const auto &m = method_list[id];
+        if (in + 1 + m.arg_size > size)
+            break;
+        calls += 1;
+
+        const uint64_t bit = skip_pure && m.pure && m.arg_size == 0 && id < 64 ? 1ull << id : 0;
+        if (!(pure_seen & bit)) {
+            data[out] = id;
+            memmove(data + out + 1, data + in + 1, m.arg_size);
+            out += 1 + m.arg_size;
+        }
+        pure_seen = m.pure ? pure_seen | bit : 0;
+        in += 1 + m.arg_size;
+    }
+    return out;
+}
+
+// Concurrent chain has leading worker selector, any value of it is canonical
+template <const auto &constr_list, const auto &method_list, bool split = false>
+size_t canonical_concurrent(uint8_t *data, size_t size) {
+    if (size < 2)
+        return 0;
+    const size_t chain_size = canonical_chain<constr_list, method_list, split, false>(data + 1, size - 1);
+    return chain_size ? chain_size + 1 : 0;
+}
+
+// FNV-1a, names canonical inputs written by tools
+inline uint64_t content_hash(const uint8_t *data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+} // namespace cfuzz
+
+///////////////////////////// DIFFERENTIAL /////////////////////////////
+
+// Harness generated with --diff runs chain on two implementations and compares
+// what their methods return. Return is kept as bytes in fixed buffer:
+// trivial values as they are, contiguous containers (strings, vectors) as hash of contents.
+// Addresses differ between two objects, so pointers are compared by what they point to
+// (char pointers as C strings), null only equals null; void, function and member pointers
+// and other returns are not compared. Floating point returns are compared by value
+// (NaN equals NaN, -0.0 equals 0.0), CFUZZ_DIFF_BITWISE compares their bytes instead.
+
+#ifdef CFUZZ_DIFF
+
+#ifndef CFUZZ_DIFF_RET_SIZE
+#define CFUZZ_DIFF_RET_SIZE 32
+#endif
+
+namespace cfuzz {
+
+enum DiffKind : uint8_t { DIFF_BYTES, DIFF_FLOAT, DIFF_DOUBLE, DIFF_LONG_DOUBLE, DIFF_NULL };
+
+struct DiffRet {
+    size_t size;
+    DiffKind kind;
+    uint8_t bytes[CFUZZ_DIFF_RET_SIZE];
+};
+
+inline thread_local DiffRet diff_ret;
+
+template <class T>
+void diff_capture(const T &value) {
+    if constexpr (std::is_pointer_v<T>) {
+        using Pointee = std::remove_cv_t<std::remove_pointer_t<T>>;
+        if constexpr (!std::is_void_v<Pointee> && !std::is_function_v<Pointee>) {
+            if (!value) {
+                diff_ret.bytes[0] = 0;
+                diff_ret.size = 1;
+                diff_ret.kind = DIFF_NULL;
+            } else if constexpr (std::is_same_v<Pointee, char>) {
+                const uint64_t h = content_hash((const uint8_t *)value, strlen(value));
+                memcpy(diff_ret.bytes, &h, sizeof(h));
+                diff_ret.size = sizeof(h);
+                diff_ret.kind = DIFF_BYTES;
+            } else {
+                diff_capture(*value);
+            }
+        }
+    } else if constexpr (std::is_member_pointer_v<T>) {
+        // not compared
+    } else if constexpr ((std::has_unique_object_representations_v<T> || std::is_floating_point_v<T>)
+                  && sizeof(T) <= CFUZZ_DIFF_RET_SIZE) {
+        memcpy(diff_ret.bytes, &value, sizeof(T));
+        diff_ret.size = sizeof(T);
+        diff_ret.kind = std::is_same_v<T, float> ? DIFF_FLOAT
+            : std::is_same_v<T, double> ? DIFF_DOUBLE
+            : std::is_same_v<T, long double> ? DIFF_LONG_DOUBLE : DIFF_BYTES;
+    } else if constexpr (requires { value.data(); value.size(); }) {
+        using Elem = std::remove_cvref_t<decltype(*value.data())>;
+        if constexpr (std::has_unique_object_representations_v<Elem>) {
+            const uint64_t h = content_hash((const uint8_t *)value.data(), value.size() * sizeof(Elem));
+            memcpy(diff_ret.bytes, &h, sizeof(h));
+            diff_ret.size = sizeof(h);
+            diff_ret.kind = DIFF_BYTES;
+        }
+    }
+}
+
+template <class T>
+bool diff_fp_equal(const DiffRet &a, const DiffRet &b) {
+    T x, y;
+    memcpy(&x, a.bytes, sizeof(T));
+    memcpy(&y, b.bytes, sizeof(T));
+    return x == y || (x != x && y != y);
+}
+
+inline bool diff_equal(const DiffRet &a, const DiffRet &b) {
+    if (a.size != b.size)
+        return false;
+    if (a.size != 0 && (a.kind == DIFF_NULL) != (b.kind == DIFF_NULL))
+        return false;
+#ifndef CFUZZ_DIFF_BITWISE
+    if (a.size != 0 && a.kind == b.kind) {
+        switch (a.kind) {
+            case DIFF_FLOAT: return diff_fp_equal<float>(a, b);
+            case DIFF_DOUBLE: return diff_fp_equal<double>(a, b);
+            case DIFF_LONG_DOUBLE: return diff_fp_equal<long double>(a, b);
+            case DIFF_BYTES:
+            case DIFF_NULL: break;
+        }
+    }
+#endif
+    return memcmp(a.bytes, b.bytes, a.size) == 0;
+}
+
+// Abort on first divergence, crash trace then shows calls leading there
+inline void diff_check(const DiffRet &a, const DiffRet &b, size_t call, const char *name) {
+    if (diff_equal(a, b))
+        return;
+
+    Out out;
+    out.n = 0;
+    out.fd = 2;
+    out.put("==cfuzz== implementations diverge at call #");
+    out.num(call);
+    out.put(" (");
+    out.put(name);
+    out.put(")\n  a:");
+    for (size_t i = 0; i < a.size; ++i) {
+        out.put(" ");
+        out.hex(a.bytes[i]);
+    }
+    out.put("\n  b:");
+    for (size_t i = 0; i < b.size; ++i) {
+        out.put(" ");
+        out.hex(b.bytes[i]);
+    }
+    out.put("\n");
+    out.flush();
+    abort();
+}
+
+} // namespace cfuzz
+
+#endif
+
+///////////////////////////// CONCURRENT /////////////////////////////
+
+// Harness generated with --concurrent=K runs method calls of one chain on K workers
+// sharing object (meant to be built with TSan). Workers are started on first exec
+// and stay parked on barrier between execs, calling thread is worker 0.
+
+#ifdef CFUZZ_CONCURRENT
+
+#include <barrier>
+#include <thread>
+
+namespace cfuzz {
+
+struct WorkerPool {
+    std::barrier<> start;
+    std::barrier<> done;
+    void (*job)(size_t, void *) = nullptr;
+    void *ctx = nullptr;
+
+    explicit WorkerPool(size_t workers) : start(workers), done(workers) {
+        for (size_t w = 1; w < workers; ++w)
+            std::thread(&WorkerPool::loop, this, w).detach();
+    }
+
+    // job and ctx are published to workers by start barrier
+    void run(void (*f)(size_t, void *), void *c) {
+        job = f;
+        ctx = c;
+        start.arrive_and_wait();
+        job(0, ctx);
+        done.arrive_and_wait();
+    }
+
+    void loop(size_t w) {
+        for (;;) {
+            start.arrive_and_wait();
+            job(w, ctx);
+            done.arrive_and_wait();
+        }
+    }
+};
+
+// Never destroyed: workers stay parked on it until exit
+inline WorkerPool &worker_pool(size_t workers) {
+    static WorkerPool *pool = new WorkerPool(workers);
+    return *pool;
+}
+
+// Call f(worker) on every worker, returns when all are done
+template <class F>
+void run_workers(size_t workers, F &f) {
+    worker_pool(workers).run([](size_t w, void *ctx) { (*(F *)ctx)(w); }, &f);
+}
+
+// Worker running call #call of chain, selector byte picks one of 256 ways to deal calls
+inline size_t worker_of(uint8_t selector, size_t call, size_t workers) {
+    return ((uint32_t(call) * 0x9e3779b1u + selector * 0x85ebca6bu) >> 16) % workers;
+}
+
+} // namespace cfuzz
+
+#endif
+
+///////////////////////////// PROFILING /////////////////////////////
+
+// CFUZZ_PROFILE: per constructor/method call counts and cycle histograms.
+// Dumped as JSON at exit and on SIGUSR1, to $CFUZZ_PROFILE_OUT or stderr.
+
+#ifdef CFUZZ_PROFILE
+
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+
+namespace cfuzz {
+
+// log2 buckets, last one also takes everything above
+constexpr size_t PROFILE_BUCKETS = 16;
+
+struct alignas(64) ProfileSlot {
+    uint64_t calls;
+    uint64_t cycles;
+    uint32_t hist[PROFILE_BUCKETS];
+};
+
+// Every thread gets own block on its first call: constructors slots followed by methods slots.
+// Blocks are never freed and are pushed to list, so dump can read them after owner thread exits.
+struct ProfileBlock {
+    ProfileBlock *next;
+    ProfileSlot *slots;
+};
+
+inline std::atomic<ProfileBlock *> profile_blocks{nullptr};
+inline std::atomic<size_t> profile_threads{0};
+inline thread_local ProfileSlot *profile_block = nullptr;
+
+inline size_t profile_sizes[2] = {0, 0};
+
+inline ProfileSlot *profile_claim() {
+    const size_t bytes = (profile_sizes[CALL_CONSTR] + profile_sizes[CALL_METHOD]) * sizeof(ProfileSlot);
+    ProfileBlock *b = (ProfileBlock *)malloc(sizeof(ProfileBlock));
+    b->slots = (ProfileSlot *)aligned_alloc(alignof(ProfileSlot), bytes ? bytes : sizeof(ProfileSlot));
+    memset(b->slots, 0, bytes);
+
+    b->next = profile_blocks.load(std::memory_order_relaxed);
+    while (!profile_blocks.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    profile_threads.fetch_add(1, std::memory_order_relaxed);
+    return b->slots;
+}
+
+struct ProfileScope {
+    ProfileSlot *slot;
+    uint64_t start;
+
+    ProfileScope(CallKind kind, size_t id) {
+        if (!profile_block)
+            profile_block = profile_claim();
+        slot = profile_block + (kind == CALL_CONSTR ? id : profile_sizes[CALL_CONSTR] + id);
+        start = now();
+    }
+
+    ~ProfileScope() {
+        const uint64_t cycles = now() - start;
+        const size_t bucket = 63 - __builtin_clzll(cycles | 1);
+        slot->calls += 1;
+        slot->cycles += cycles;
+        slot->hist[bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1] += 1;
+    }
+};
+
+inline void profile_dump() {
+    const char *path = getenv("CFUZZ_PROFILE_OUT");
+    Out out;
+    out.n = 0;
+    out.fd = path ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : 2;
+    if (out.fd < 0)
+        return;
+
+    const ProfileBlock *blocks = profile_blocks.load(std::memory_order_acquire);
+    out.put("{\"threads\": ");
+    out.num(profile_threads.load(std::memory_order_relaxed));
+    for (size_t kind = 0; kind < 2; ++kind) {
+        out.put(kind == CALL_CONSTR ? ", \"constructors\": [" : ", \"methods\": [");
+        for (size_t id = 0; id < profile_sizes[kind]; ++id) {
+            ProfileSlot sum = {};
+            for (const ProfileBlock *block = blocks; block; block = block->next) {
+                const ProfileSlot &s = block->slots[(kind == CALL_CONSTR ? 0 : profile_sizes[CALL_CONSTR]) + id];
+                sum.calls += s.calls;
+                sum.cycles += s.cycles;
+                for (size_t b = 0; b < PROFILE_BUCKETS; ++b)
+                    sum.hist[b] += s.hist[b];
+            }
+
+            out.put(id ? ", {\"id\": " : "{\"id\": ");
+            out.num(id);
+            out.put(", \"name\": \"");
+            out.put(call_name(CallKind(kind), id));
+            out.put("\"");
+            out.put(", \"calls\": ");
+            out.num(sum.calls);
+            out.put(", \"cycles\": ");
+            out.num(sum.cycles);
+            out.put(", \"log2_cycles_hist\": [");
+            for (size_t b = 0; b < PROFILE_BUCKETS; ++b) {
+                if (b)
+                    out.put(", ");
+                out.num(sum.hist[b]);
+            }
+            out.put("]}");
+        }
+        out.put("]");
+    }
+    out.put("}\n");
+    out.flush();
+
+    if (path)
+        close(out.fd);
+}
+
+inline void profile_signal(int) {
+    profile_dump();
+}
+
+// Called once from generated harness with total number of constructors and methods,
+// returns value to initialize a global with
+inline bool profile_register(size_t constr_size, size_t method_size) {
+    profile_sizes[CALL_CONSTR] = constr_size;
+    profile_sizes[CALL_METHOD] = method_size;
+
+    atexit(profile_dump);
+    struct sigaction sa = {};
+    sa.sa_handler = profile_signal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, nullptr);
+    return true;
+}
+
+} // namespace cfuzz
+
+#define CFUZZ_PROFILE_CALL(kind, id) cfuzz::ProfileScope cfuzz_profile_scope(cfuzz::kind, id)
+
+#else
+
+#define CFUZZ_PROFILE_CALL(kind, id)
+
+#endif
+
+///////////////////////////// ALLOCATIONS /////////////////////////////
+
+// CFUZZ_ALLOC: global operator new/delete (and malloc family, unless ASan owns it)
+// are counted per constructor/method being called: allocations, bytes and peak of live bytes.
+// Inputs whose allocations grow superlinearly with chain length are reported
+// (and abort with CFUZZ_ALLOC_ABORT=1 in environment, so fuzzer keeps them).
+// Dumped as JSON at exit to $CFUZZ_ALLOC_OUT or stderr.
+// Replaces global allocation functions, so harness must be the only file including it.
+
+#ifdef CFUZZ_ALLOC
+
+#include <atomic>
+#include <fcntl.h>
+#include <malloc.h>
+#include <new>
+
+#if defined(__SANITIZE_ADDRESS__)
+#define CFUZZ_ALLOC_NO_MALLOC
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CFUZZ_ALLOC_NO_MALLOC
+#endif
+#endif
+
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void __libc_free(void *);
+}
+
+namespace cfuzz {
+
+// growth is only checked for execs allocating at least this much
+constexpr uint64_t ALLOC_MIN_GROWTH = 1 << 16;
+
+struct AllocSlot {
+    uint64_t calls;
+    uint64_t allocs;
+    uint64_t bytes;
+    uint64_t peak;
+};
+
+// Block of thread is constructors slots followed by methods slots, listed as in profiling
+struct AllocBlock {
+    AllocBlock *next;
+    AllocSlot *slots;
+};
+
+inline std::atomic<AllocBlock *> alloc_blocks{nullptr};
+inline std::atomic<size_t> alloc_threads{0};
+inline size_t alloc_sizes[2] = {0, 0};
+
+inline uint64_t alloc_superlinear = 0;
+
+// Only allocations made while slot is set (inside of call) are counted
+struct AllocThread {
+    AllocSlot *block;
+    AllocSlot *slot;
+    int64_t live;
+    int64_t peak;
+
+    // current exec: bytes and calls so far, bytes after first 2^k calls
+    bool in_exec;
+    uint64_t exec_bytes;
+    uint64_t exec_calls;
+    uint64_t bytes_at[64];
+};
+
+inline thread_local AllocThread alloc_thread = {};
+
+inline void alloc_note(void *p, size_t size) {
+    AllocThread &t = alloc_thread;
+    if (!p || !t.slot)
+        return;
+    t.slot->allocs += 1;
+    t.slot->bytes += size;
+    t.exec_bytes += size;
+    t.live += malloc_usable_size(p);
+    if (t.live > t.peak)
+        t.peak = t.live;
+}
+
+inline void alloc_forget(void *p) {
+    AllocThread &t = alloc_thread;
+    if (p && t.slot)
+        t.live -= malloc_usable_size(p);
+}
+
+inline void *alloc_raw(size_t size) {
+#ifdef CFUZZ_ALLOC_NO_MALLOC
+    return malloc(size);
+#else
+    return __libc_malloc(size);
+#endif
+}
+
+inline void free_raw(void *p) {
+#ifdef CFUZZ_ALLOC_NO_MALLOC
+    free(p);
+#else
+    __libc_free(p);
+#endif
+}
+
+inline AllocSlot *alloc_claim() {
+    const size_t bytes = (alloc_sizes[CALL_CONSTR] + alloc_sizes[CALL_METHOD]) * sizeof(AllocSlot);
+    AllocBlock *b = (AllocBlock *)alloc_raw(sizeof(AllocBlock));
+    b->slots = (AllocSlot *)alloc_raw(bytes);
+    memset(b->slots, 0, bytes);
+
+    b->next = alloc_blocks.load(std::memory_order_relaxed);
+    while (!alloc_blocks.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    alloc_threads.fetch_add(1, std::memory_order_relaxed);
+    return b->slots;
+}
+
+struct AllocScope {
+    AllocSlot *slot;
+    int64_t base;
+
+    AllocScope(CallKind kind, size_t id) {
+        AllocThread &t = alloc_thread;
+        if (!t.block)
+            t.block = alloc_claim();
+        slot = t.block + (kind == CALL_CONSTR ? id : alloc_sizes[CALL_CONSTR] + id);
+        slot->calls += 1;
+        base = t.live;
+        t.peak = t.live;
+        t.slot = slot;
+
+        if (t.in_exec) {
+            if (t.exec_calls && (t.exec_calls & (t.exec_calls - 1)) == 0)
+                t.bytes_at[63 - __builtin_clzll(t.exec_calls)] = t.exec_bytes;
+            t.exec_calls += 1;
+        }
+    }
+
+    ~AllocScope() {
+        AllocThread &t = alloc_thread;
+        if (t.peak > base && uint64_t(t.peak - base) > slot->peak)
+            slot->peak = t.peak - base;
+        t.slot = nullptr;
+    }
+};
+
+// Superlinear when first 2m calls allocate over 3 times more than first m
+struct AllocExec {
+    const uint8_t *data;
+    size_t size;
+
+    AllocExec(const uint8_t *d, size_t s) : data(d), size(s) {
+        AllocThread &t = alloc_thread;
+        t.in_exec = true;
+        t.exec_bytes = 0;
+        t.exec_calls = 0;
+    }
+
+    ~AllocExec() {
+        AllocThread &t = alloc_thread;
+        t.in_exec = false;
+
+        // largest 2m <= calls, with m >= 4 so constructor doesn't dominate
+        const uint64_t calls = t.exec_calls;
+        if (calls < 8)
+            return;
+        const size_t k = 63 - __builtin_clzll(calls);
+        const uint64_t b_m = t.bytes_at[k - 1], b_2m = calls == (1ull << k) ? t.exec_bytes : t.bytes_at[k];
+        if (b_2m < ALLOC_MIN_GROWTH || b_2m <= 3 * b_m)
+            return;
+
+        alloc_superlinear += 1;
+        Out out;
+        out.n = 0;
+        out.fd = 2;
+        out.put("==cfuzz== superlinear allocations: ");
+        out.num(b_m);
+        out.put(" bytes in first ");
+        out.num(1ull << (k - 1));
+        out.put(" calls, ");
+        out.num(b_2m);
+        out.put(" in first ");
+        out.num(1ull << k);
+        out.put(", input:");
+        for (size_t i = 0; i < size && i < 64; ++i) {
+            out.put(" ");
+            out.hex(data[i]);
+        }
+        out.put(size > 64 ? " ...\n" : "\n");
+        out.flush();
+
+        const char *env = getenv("CFUZZ_ALLOC_ABORT");
+        if (env && env[0] == '1')
+            abort();
+    }
+};
+
+inline void alloc_dump() {
+    const char *path = getenv("CFUZZ_ALLOC_OUT");
+    Out out;
+    out.n = 0;
+    out.fd = path ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : 2;
+    if (out.fd < 0)
+        return;
+
+    const AllocBlock *blocks = alloc_blocks.load(std::memory_order_acquire);
+    out.put("{\"threads\": ");
+    out.num(alloc_threads.load(std::memory_order_relaxed));
+    out.put(", \"superlinear_inputs\": ");
+    out.num(alloc_superlinear);
+    for (size_t kind = 0; kind < 2; ++kind) {
+        out.put(kind == CALL_CONSTR ? ", \"constructors\": [" : ", \"methods\": [");
+        for (size_t id = 0; id < alloc_sizes[kind]; ++id) {
+            AllocSlot sum = {};
+            for (const AllocBlock *b = blocks; b; b = b->next) {
+                const AllocSlot &s = b->slots[(kind == CALL_CONSTR ? 0 : alloc_sizes[CALL_CONSTR]) + id];
+                sum.calls += s.calls;
+                sum.allocs += s.allocs;
+                sum.bytes += s.bytes;
+                if (s.peak > sum.peak)
+                    sum.peak = s.peak;
+            }
+
+            out.put(id ? ", {\"id\": " : "{\"id\": ");
+            out.num(id);
+            out.put(", \"name\": \"");
+            out.put(call_name(CallKind(kind), id));
+            out.put("\", \"calls\": ");
+            out.num(sum.calls);
+            out.put(", \"allocs\": ");
+            out.num(sum.allocs);
+            out.put(", \"bytes\": ");
+            out.num(sum.bytes);
+            out.put(", \"peak_live_bytes\": ");
+            out.num(sum.peak);
+            out.put("}");
+        }
+        out.put("]");
+    }
+    out.put("}\n");
+    out.flush();
+
+    if (path)
+        close(out.fd);
+}
+
+// Called once from generated harness with total number of constructors and methods,
+// returns value to initialize a global with
+inline bool alloc_register(size_t constr_size, size_t method_size) {
+    alloc_sizes[CALL_CONSTR] = constr_size;
+    alloc_sizes[CALL_METHOD] = method_size;
+    atexit(alloc_dump);
+    return true;
+}
+
+} // namespace cfuzz
+
+void *operator new(size_t size) {
+    void *p = cfuzz::alloc_raw(size);
+    if (!p)
+        throw std::bad_alloc();
+    cfuzz::alloc_note(p, size);
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    void *p = cfuzz::alloc_raw(size);
+    cfuzz::alloc_note(p, size);
+    return p;
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept {
+    cfuzz::alloc_forget(p);
+    cfuzz::free_raw(p);
+}
+
+void operator delete[](void *p) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    operator delete(p);
+}
+
+#ifndef CFUZZ_ALLOC_NO_MALLOC
+
+extern "C" void *malloc(size_t size) {
+    void *p = __libc_malloc(size);
+    cfuzz::alloc_note(p, size);
+    return p;
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+    void *p = __libc_calloc(n, size);
+    cfuzz::alloc_note(p, n * size);
+    return p;
+}
+
+// old block is only gone if realloc didn't fail
+extern "C" void *realloc(void *old, size_t size) {
+    const size_t old_size = old ? malloc_usable_size(old) : 0;
+    void *p = __libc_realloc(old, size);
+    if ((p || size == 0) && cfuzz::alloc_thread.slot)
+        cfuzz::alloc_thread.live -= old_size;
+    cfuzz::alloc_note(p, size);
+    return p;
+}
+
+extern "C" void free(void *p) {
+    cfuzz::alloc_forget(p);
+    __libc_free(p);
+}
+
+#endif
+
+#define CFUZZ_ALLOC_CALL(kind, id) cfuzz::AllocScope cfuzz_alloc_scope(cfuzz::kind, id)
+#define CFUZZ_ALLOC_EXEC(data, size) cfuzz::AllocExec cfuzz_alloc_exec(data, size)
+
+#else
+
+#define CFUZZ_ALLOC_CALL(kind, id)
+#define CFUZZ_ALLOC_EXEC(data, size)
+
+#endif
+
+///////////////////////////// CRASH TRACE /////////////////////////////
+
+// On by default, CFUZZ_NO_TRACE turns it off.
+// Each dispatched call is recorded into per-thread ring buffer,
+// and fatal signal handler prints the last calls with their argument bytes.
+
+#ifndef CFUZZ_NO_TRACE
+
+#include <csignal>
+
+namespace cfuzz {
+
+// power of two
+constexpr size_t TRACE_SIZE = 256;
+// argument bytes printed per call
+constexpr size_t TRACE_ARG_BYTES = 16;
+
+struct TraceEntry {
+    uint32_t offset;
+    uint16_t id;
+    uint8_t kind;
+};
+
+inline thread_local TraceEntry trace_ring[TRACE_SIZE];
+inline thread_local uint32_t trace_pos;
+inline thread_local const uint8_t *trace_data;
+
+const int TRACE_SIGNALS[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+inline struct sigaction trace_prev[std::size(TRACE_SIGNALS)];
+
+inline void trace_print() {
+    Out out;
+    out.n = 0;
+    out.fd = 2;
+
+    if (trace_pos == 0) {
+        out.put("==cfuzz== crash before first call\n");
+        out.flush();
+        return;
+    }
+
+    const uint32_t first = trace_pos > TRACE_SIZE ? trace_pos - TRACE_SIZE : 0;
+    out.put("==cfuzz== crash during call #");
+    out.num(trace_pos - 1);
+    out.put(", call trace:\n");
+    for (uint32_t i = first; i < trace_pos; ++i) {
+        const TraceEntry &e = trace_ring[i & (TRACE_SIZE - 1)];
+        const size_t arg_size = call_arg_size(CallKind(e.kind), e.id);
+
+        out.put("  #");
+        out.num(i);
+        out.put(" ");
+        out.put(call_name(CallKind(e.kind), e.id));
+        out.put(" @");
+        out.num(e.offset);
+        out.put(":");
+        for (size_t b = 0; b < arg_size && b < TRACE_ARG_BYTES; ++b) {
+            out.put(" ");
+            out.hex(trace_data[e.offset + b]);
+        }
+        if (arg_size > TRACE_ARG_BYTES)
+            out.put(" ...");
+        out.put("\n");
+    }
+    out.flush();
+}
+
+inline void trace_signal(int sig, siginfo_t *info, void *ctx) {
+    if (trace_data)
+        trace_print();
+    trace_data = nullptr;
+
+    // Hand over to whoever was there before (libFuzzer, sanitizer or default)
+    for (size_t i = 0; i < std::size(TRACE_SIGNALS); ++i) {
+        if (TRACE_SIGNALS[i] != sig)
+            continue;
+        const struct sigaction &prev = trace_prev[i];
+        sigaction(sig, &prev, nullptr);
+        if (prev.sa_flags & SA_SIGINFO)
+            prev.sa_sigaction(sig, info, ctx);
+        else if (prev.sa_handler == SIG_DFL)
+            raise(sig);
+        else if (prev.sa_handler != SIG_IGN)
+            prev.sa_handler(sig);
+    }
+}
+
+// Installed on first exec, so it runs before handlers libFuzzer sets up in main
+inline void trace_install() {
+    struct sigaction sa = {};
+    sa.sa_sigaction = trace_signal;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    for (size_t i = 0; i < std::size(TRACE_SIGNALS); ++i)
+        sigaction(TRACE_SIGNALS[i], &sa, &trace_prev[i]);
+}
+
+inline void trace_begin(const uint8_t *data) {
+    static std::atomic<bool> installed{false};
+    if (!installed.load(std::memory_order_relaxed) && !installed.exchange(true))
+        trace_install();
+    trace_data = data;
+    trace_pos = 0;
+}
+
+inline void trace_call(CallKind kind, size_t id, size_t offset) {
+    trace_ring[trace_pos & (TRACE_SIZE - 1)] = {uint32_t(offset), uint16_t(id), uint8_t(kind)};
+    trace_pos += 1;
+}
+
+// Trace is on until exec returns (by any path), so later crash outside of chain
+// doesn't print calls of finished exec and read its input
+struct TraceScope {
+    explicit TraceScope(const uint8_t *data) { trace_begin(data); }
+    ~TraceScope() { trace_data = nullptr; }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+};
+
+} // namespace cfuzz
+
+#define CFUZZ_TRACE_BEGIN(data) const cfuzz::TraceScope trace_scope(data)
+#define CFUZZ_TRACE_CALL(kind, id, offset) cfuzz::trace_call(cfuzz::kind, id, offset)
+
+#else
+
+#define CFUZZ_TRACE_BEGIN(data)
+#define CFUZZ_TRACE_CALL(kind, id, offset)
+
+#endif
+
+///////////////////////////// STATE FEEDBACK /////////////////////////////
+
+// CFUZZ_STATE: obj state is hashed after constructor and every method call that isn't pure,
+// and hash bumps one of libFuzzer's extra counters, so new object states count as new
+// coverage (small classes saturate code coverage fast while their states keep changing).
+// State must hash same in every run: obj bytes are only taken for classes without padding
+// (std::has_unique_object_representations), others don't compile without projection
+// cfuzz_state(const Class &), found by ADL and returning such value (or floating point),
+// or contiguous container of them. Pointers can't be told from integers, so classes
+// holding pointers (or heap addresses in general) need projection too, it always wins.
+
+#ifdef CFUZZ_STATE
+
+#ifndef CFUZZ_STATE_COUNTERS
+#define CFUZZ_STATE_COUNTERS 4096
+#endif
+
+namespace cfuzz {
+
+// libFuzzer clears counters before each exec and uses them as features
+__attribute__((section("__libfuzzer_extra_counters")))
+inline uint8_t state_counters[CFUZZ_STATE_COUNTERS];
+
+template <class T>
+constexpr bool state_bytes = std::has_unique_object_representations_v<T> || std::is_floating_point_v<T>;
+
+template <class T>
+uint64_t state_hash(const T &value) {
+    if constexpr (requires { value.data(); value.size(); }) {
+        using Elem = std::remove_cvref_t<decltype(*value.data())>;
+        static_assert(state_bytes<Elem>, "cfuzz_state container elements must have no padding");
+        return content_hash((const uint8_t *)value.data(), value.size() * sizeof(Elem));
+    } else {
+        static_assert(state_bytes<T>, "cfuzz_state must return value without padding");
+        return content_hash((const uint8_t *)&value, sizeof(T));
+    }
+}
+
+template <class T>
+void state_call(const T &obj, bool pure) {
+    if (pure)
+        return;
+
+    uint64_t h;
+    if constexpr (std::is_same_v<T, NoObject>) {
+        return;
+    } else if constexpr (requires { cfuzz_state(obj); }) {
+        h = state_hash(cfuzz_state(obj));
+    } else {
+        static_assert(std::has_unique_object_representations_v<T>,
+            "CFUZZ_STATE: class has padding or floating point members, define cfuzz_state(const Class &)");
+        h = state_hash(obj);
+    }
+
+    uint8_t &c = state_counters[(h ^ h >> 32) % CFUZZ_STATE_COUNTERS];
+    c += c != 255;
+}
+
+} // namespace cfuzz
+
+#define CFUZZ_STATE_CALL(obj, pure) cfuzz::state_call(obj, pure)
+
+#else
+
+#define CFUZZ_STATE_CALL(obj, pure)
+
+#endif
+
+///////////////////////////// TWO PHASE /////////////////////////////
+
+// CFUZZ_TWO_PHASE: run_chain first decodes all method calls into array of ops on stack,
+// then runs ops in tight loop, so decoding (ids modulo list size, bounds checks) isn't
+// in front of every indirect call. When all methods take same argument bytes, call i is
+// at fixed offset and ops are decoded without dependency between them (vectorizable).
+// Input with truncated trailing call is rejected before constructor runs.
+// At most CFUZZ_DECODE_CAPACITY (default 1024) calls run, later ones are ignored
+// like calls past call limit.
+
+#ifndef CFUZZ_DECODE_CAPACITY
+#define CFUZZ_DECODE_CAPACITY 1024
+#endif
+
+namespace cfuzz {
+
+constexpr size_t decode_capacity = CFUZZ_DECODE_CAPACITY;
+
+template <class Fn>
+struct Op {
+    Fn fn;
+    const uint8_t *args;
+    uint32_t id;
+};
+
+// Argument size of every call of list, SIZE_MAX if sizes differ
+template <const auto &list>
+inline const size_t uniform_arg_size = [] {
+    for (const auto &c : list)
+        if (c.arg_size != list[0].arg_size)
+            return SIZE_MAX;
+    return list[0].arg_size;
+}();
+
+// Method calls left in chain into ops (at most limit), returns op count and sets left
+// to bytes no call was decoded from
+template <const auto &method_list, bool split, class Fn>
+size_t decode_ops(const uint8_t *data, ChainReader<split> chain, Op<Fn> *ops, size_t limit, size_t &left) {
+    const size_t stride = uniform_arg_size<method_list>;
+    if (stride == SIZE_MAX) {
+        Call call;
+        size_t n = 0;
+        while (n < limit && chain.template next<method_list>(call))
+            ops[n++] = {method_list[call.id].fn, data + call.args, uint32_t(call.id)};
+        left = chain.back - chain.front;
+        return n;
+    }
+
+    const size_t size = chain.back - chain.front;
+    const size_t fit = size / (1 + stride);
+    const size_t n = fit < limit ? fit : limit;
+    for (size_t i = 0; i < n; ++i) {
+        const size_t op = split ? chain.front + i : chain.front + i * (1 + stride);
+        const size_t args = split ? chain.back - (i + 1) * stride : op + 1;
+        const uint32_t id = data[op] % std::size(method_list);
+        ops[i] = {method_list[id].fn, data + args, id};
+    }
+    left = size - n * (1 + stride);
+    return n;
+}
+
+// Repeated argumentless pure calls are dropped as in run_chain (CFUZZ_SKIP_PURE), returns ops left
+template <const auto &method_list, class Fn>
+size_t drop_pure(Op<Fn> *ops, size_t n) {
+    uint64_t pure_seen = 0;
+    size_t len = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const auto &m = method_list[ops[i].id];
+        const uint64_t bit = skip_pure_calls && m.pure && m.arg_size == 0 && ops[i].id < 64 ? 1ull << ops[i].id : 0;
+        if (!(pure_seen & bit))
+            ops[len++] = ops[i];
+        pure_seen = m.pure ? pure_seen | bit : 0;
+    }
+    return len;
+}
+
+template <const auto &constr_list, const auto &method_list, bool split>
+int run_decoded(const uint8_t *data, size_t size, size_t constr_base, size_t method_base) {
+    if (size == 0)
+        return 0;
+
+    ChainReader<split> chain(data, size);
+    Call constr;
+    if (!chain.template next<constr_list>(constr))
+        return 0;
+
+    Op<decltype(method_list[0].fn)> ops[decode_capacity];
+    const size_t limit = call_limit && call_limit < decode_capacity ? call_limit : decode_capacity;
+    size_t left;
+    size_t len = decode_ops<method_list>(data, chain, ops, limit, left);
+    if (left != 0 && len < limit)
+        return 0;
+    if (left != 0)
+        budget_call_hits.fetch_add(1, std::memory_order_relaxed);
+    len = drop_pure<method_list>(ops, len);
+
+    CFUZZ_TRACE_BEGIN(data);
+    CFUZZ_ALLOC_EXEC(data, size);
+
+    CFUZZ_TRACE_CALL(CALL_CONSTR, constr_base + constr.id, constr.args);
+    auto obj = constr_list[constr.id].fn(data + constr.args);
+    CFUZZ_STATE_CALL(obj, false);
+
+    const uint64_t start = budget_begin();
+    for (size_t i = 0; i < len; ++i) {
+        // only cycle limit is left to hit
+        if (budget_over(i, start))
+            return 0;
+        CFUZZ_TRACE_CALL(CALL_METHOD, method_base + ops[i].id, ops[i].args - data);
+        ops[i].fn(&obj, ops[i].args);
+        CFUZZ_STATE_CALL(obj, method_list[ops[i].id].pure);
+    }
+    return 0;
+}
+
+} // namespace cfuzz
+
+///////////////////////////// COVERAGE HOOKS /////////////////////////////
+
+// Tools running harness in process with own coverage (distill, coord) define CFUZZ_COVERAGE_HOOKS
+// and build class sources with -fsanitize-coverage=trace-pc-guard (or gcc's trace-pc, pc is
+// hashed into map then). Edges are recorded only while cfuzz::cov_map is set, so tool's own
+// (instrumented) code between execs isn't counted; hit counts saturate at 255.
+
+#define CFUZZ_NO_COVERAGE __attribute__((no_sanitize("coverage")))
+#if defined(__GNUC__) && !defined(__clang__)
+#undef CFUZZ_NO_COVERAGE
+#define CFUZZ_NO_COVERAGE __attribute__((no_sanitize_coverage))
+#endif
+
+#ifdef CFUZZ_COVERAGE_HOOKS
+
+namespace cfuzz {
+
+// Edges past map size share slots
+constexpr size_t COV_MAP_SIZE = 1 << 16;
+
+struct CovMap {
+    uint8_t hit[COV_MAP_SIZE];
+    uint32_t touched[COV_MAP_SIZE];
+    size_t touched_len;
+};
+
+inline CovMap *cov_map = nullptr;
+
+CFUZZ_NO_COVERAGE inline void cov_hit(size_t idx) {
+    CovMap *m = cov_map;
+    if (!m)
+        return;
+    uint8_t &hit = m->hit[idx];
+    if (hit == 0)
+        m->touched[m->touched_len++] = idx;
+    hit += hit != 255;
+}
+
+} // namespace cfuzz
+
+extern "C" CFUZZ_NO_COVERAGE void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop) {
+    static uint32_t next = 0;
+    if (start == stop || *start)
+        return;
+    for (uint32_t *g = start; g < stop; ++g)
+        *g = ++next;
+}
+
+extern "C" CFUZZ_NO_COVERAGE void __sanitizer_cov_trace_pc_guard(uint32_t *guard) {
+    if (*guard)
+        cfuzz::cov_hit(*guard % cfuzz::COV_MAP_SIZE);
+}
+
+extern "C" CFUZZ_NO_COVERAGE void __sanitizer_cov_trace_pc() {
+    const uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+    cfuzz::cov_hit((pc ^ pc >> 16) % cfuzz::COV_MAP_SIZE);
+}
+
+#endif
+
+///////////////////////////// MUTATE STUB /////////////////////////////
+
+// Tools running mutfuzz without libFuzzer (AFL++ mutator, coord, mutbench) define CFUZZ_MUTATE_STUB
+// for byte level LLVMFuzzerMutate: it flips, replaces or bumps one byte and never changes size.
+// Sequence is xorshift64 of per thread cfuzz::stub_state, same every run unless tool reseeds it.
+
+#ifdef CFUZZ_MUTATE_STUB
+
+namespace cfuzz {
+
+inline thread_local uint64_t stub_state = 0x9e3779b97f4a7c15ull;
+
+inline void stub_seed(uint64_t seed) {
+    stub_state = seed ? seed : 0x9e3779b97f4a7c15ull;
+}
+
+inline uint64_t stub_next() {
+    stub_state ^= stub_state << 13;
+    stub_state ^= stub_state >> 7;
+    stub_state ^= stub_state << 17;
+    return stub_state;
+}
+
+} // namespace cfuzz
+
+extern "C" size_t LLVMFuzzerMutate(uint8_t *Data, size_t Size, size_t MaxSize) {
+    if (Size == 0)
+        return 0;
+    const uint64_t r = cfuzz::stub_next();
+    uint8_t &b = Data[(r >> 8) % Size];
+    switch (r % 3) {
+        case 0: b ^= 1 << (r >> 4 & 7); break;
+        case 1: b = r >> 16; break;
+        case 2: b += r >> 3 & 1 ? 1 : -1; break;
+    }
+    return Size;
+}
+
+#endif
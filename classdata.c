@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <string.h>
+#include "classdata.h"
+
+typedef enum CXChildVisitResult CXChildVisitResult;
+
+// Names of methods in visit order
+typedef struct {
+    char **items;
+    size_t len;
+} Names;
+
+typedef struct {
+    MemberFn fn;
+    void *data;
+    CXCursor owner;
+    int inherited;
+    Names *names;
+    // methods before that one come from derived classes and hide base ones by name
+    size_t derived_len;
+    CXCursor *bases;
+    size_t base_len;
+    size_t *nodes;
+} MemberVisit;
+
+static int is_hidden(const MemberVisit *v, const char *name) {
+    for (size_t i = 0; v->inherited && i < v->derived_len; ++i)
+        if (strcmp(v->names->items[i], name) == 0)
+            return 1;
+    return 0;
+}
+
+static CXChildVisitResult member_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
+    MemberVisit *v = (MemberVisit *)client_data;
+    *v->nodes += 1;
+
+    // only public members (and public bases) can be called from harness
+    if (clang_getCXXAccessSpecifier(cursor) != CX_CXXPublic)
+        return CXChildVisit_Continue;
+
+    // deleted ones can't be called
+    if (clang_CXXMethod_isDeleted(cursor))
+        return CXChildVisit_Continue;
+
+    if (clang_getCursorKind(cursor) == CXCursor_CXXBaseSpecifier) {
+        CXCursor base = clang_getTypeDeclaration(clang_getCursorType(cursor));
+        if (!clang_Cursor_isNull(base)) {
+            v->bases = realloc(v->bases, (v->base_len + 1) * sizeof(CXCursor));
+            v->bases[v->base_len++] = base;
+        }
+    } else if (clang_getCursorKind(cursor) == CXCursor_Constructor && !v->inherited) {
+        v->fn(cursor, MEMBER_CONSTRUCTOR, v->owner, 0, v->data);
+    } else if (clang_getCursorKind(cursor) == CXCursor_CXXMethod) {
+        // base method is hidden by derived one with same name
+        // (that also drops second copy of base reached through two paths)
+        CXString name = clang_getCursorSpelling(cursor);
+        const int hidden = is_hidden(v, clang_getCString(name));
+        if (!hidden) {
+            v->names->items = realloc(v->names->items, (v->names->len + 1) * sizeof(char *));
+            v->names->items[v->names->len++] = strdup(clang_getCString(name));
+        }
+        clang_disposeString(name);
+        if (!hidden)
+            v->fn(cursor, clang_CXXMethod_isStatic(cursor) ? MEMBER_STATIC : MEMBER_METHOD,
+                  v->owner, v->inherited, v->data);
+    }
+    return CXChildVisit_Continue;
+}
+
+// Own members first, then public methods of public bases (recursively),
+// so inherited method is only taken when nothing derived hides it
+static void visit_class(CXCursor class_cursor, int inherited, MemberFn fn, void *data, Names *names, size_t *nodes) {
+    MemberVisit v = {fn, data, class_cursor, inherited, names, names->len, 0, 0, nodes};
+    clang_visitChildren(class_cursor, member_visitor, (CXClientData)&v);
+    for (size_t i = 0; i < v.base_len; ++i)
+        visit_class(v.bases[i], 1, fn, data, names, nodes);
+    free(v.bases);
+}
+
+size_t visit_members(CXCursor class_cursor, MemberFn fn, void *data) {
+    Names names = {0, 0};
+    size_t nodes = 0;
+    visit_class(class_cursor, 0, fn, data, &names, &nodes);
+    for (size_t i = 0; i < names.len; ++i)
+        free(names.items[i]);
+    free(names.items);
+    return nodes;
+}
+
+size_t template_name_len(const char *class_name) {
+    const char *args = strchr(class_name, '<');
+    size_t len = args ? (size_t)(args - class_name) : strlen(class_name);
+    while (len && class_name[len - 1] == ' ')
+        --len;
+    return len;
+}
+
+int returns_class(const char *return_type, const char *class_name) {
+    const size_t ret_len = template_name_len(return_type);
+    size_t start = 0;
+    for (size_t i = 0; i < ret_len; ++i)
+        if (return_type[i] == ':')
+            start = i + 1;
+    const size_t len = template_name_len(class_name);
+    return ret_len - start == len && strncmp(return_type + start, class_name, len) == 0;
+}
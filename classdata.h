@@ -0,0 +1,29 @@
+/// Class member extraction shared by generator (main.c) and coder (coder.c): both build
+/// their call tables from visit_members, so call ids of harness and of coded inputs agree.
+/// Link it with both: cc main.c classdata.c -lclang, cc coder.c classdata.c -lclang -lm
+
+#pragma once
+
+#include <stddef.h>
+#include <clang-c/Index.h>
+
+typedef enum {
+    MEMBER_CONSTRUCTOR,
+    MEMBER_METHOD,
+    MEMBER_STATIC,
+} MemberKind;
+
+// owner is class declaring member (base class if inherited)
+typedef void (*MemberFn)(CXCursor member, MemberKind kind, CXCursor owner, int inherited, void *data);
+
+// Public members in harness table order: own constructors and methods first, then public
+// methods of public bases (recursively) not hidden by derived name; deleted ones are skipped.
+// Returns number of AST nodes visited
+size_t visit_members(CXCursor class_cursor, MemberFn fn, void *data);
+
+// Length of class name without template arguments ("RingBuf" of "RingBuf<int, 64>")
+size_t template_name_len(const char *class_name);
+
+// Type spelling names class (namespace and template arguments aside), so static method
+// returning it is factory of object chain
+int returns_class(const char *return_type, const char *class_name);
@@ -1,16 +1,57 @@
+/// Call chain compiler and decompiler
+///
+/// Chains are written as calls of class from main.c harness, one statement per `;`:
+///   Time(5);
+///   set(23);
+///   zero();
+/// First call is constructor and names class (it picks class selector byte when
+/// harness has several classes): Class(...), static factory Class::make(...), or
+/// Class::static() starting chain of static calls without object. Arguments are integers (decimal, 0x hex, 'c'),
+/// floats, true/false or raw bytes x"0a0b" of exact argument size. Overloads are
+/// resolved by argument count, name#id picks call by its id in harness tables.
+/// Statement x"..." appends raw bytes (decompiler keeps truncated trailing call this way).
+///
+///   coder [--split] compile <in> <out> <header> <class>[,<class>...] ...args_to_compiler...
+///   coder [--split] decompile <in> <out> <header> <class>[,<class>...] ...args_to_compiler...
+///   coder [--split] mine <tests> <out_dir> <header> <class>[,<class>...] ...args_to_compiler...
+/// <in> and <out> are files or directories: every file of directory is converted,
+/// compiled ones lose .chain suffix and decompiled ones get it.
+/// mine parses unit tests (file, or .cpp/.cc/.cxx files of directory) with same compiler args,
+/// and every local object of class becomes seed: its constructor and then method calls on it
+/// in source order (also through pointers and references to it), constant arguments are
+/// evaluated and others are zeroed. Calls on other objects (fixture members, parameters) are
+/// counted as skipped. Seeds are named by hash of their bytes, so same chain from several tests is written once.
+/// --split is for harness generated with --split (see wire format in cfuzz.hpp).
+
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <clang-c/Index.h>
-
-typedef unsigned int uint;
+#include "classdata.h"
 
 typedef enum CXChildVisitResult CXChildVisitResult;
 
 ///////////////////////////// PARSE ARGS /////////////////////////////
 
+typedef enum {
+    MODE_COMPILE,
+    MODE_DECOMPILE,
+    MODE_MINE,
+} Mode;
+
 typedef struct {
+    Mode mode;
+    // split wire format
+    int split;
+    const char *input;
+    const char *output;
     const char *header_path;
     const char *class_name;
     const char **compiler_args;
@@ -19,21 +60,40 @@ typedef struct {
 
 // If error all FuzzerArgs null
 FuzzerArgs parse_args(const int argc, const char **argv) {
-    FuzzerArgs args = {0, 0, 0, argc - 3};
+    // options go before mode
+    const int split = argc > 1 && strcmp(argv[1], "--split") == 0;
+    const int opt = 1 + split;
+    FuzzerArgs args = {MODE_COMPILE, split, 0, 0, 0, 0, 0, argc - opt - 5};
+
+    if (argc - opt < 5)
+        return args;
 
-    if (argc < 3)
+    if (strcmp(argv[opt], "compile") == 0)
+        args.mode = MODE_COMPILE;
+    else if (strcmp(argv[opt], "decompile") == 0)
+        args.mode = MODE_DECOMPILE;
+    else if (strcmp(argv[opt], "mine") == 0)
+        args.mode = MODE_MINE;
+    else
         return args;
 
-    args.header_path = argv[1];
-    args.class_name = argv[2];
-    args.compiler_args = argv + 3;
+    args.input = argv[opt + 1];
+    args.output = argv[opt + 2];
+    args.header_path = argv[opt + 3];
+    args.class_name = argv[opt + 4];
+    args.compiler_args = argv + opt + 5;
 
     return args;
 }
 
 // Print usage and return error code
 int usage(const char *program_name) {
-    printf("Usage: %s <header> <class> ...args_to_compiler...\n", program_name);
+    printf("Usage: %s [--split] compile <in> <out> <header> <class>[,<class>...] ...args_to_compiler...\n", program_name);
+    printf("       %s [--split] decompile <in> <out> <header> <class>[,<class>...] ...args_to_compiler...\n", program_name);
+    printf("       %s [--split] mine <tests> <out_dir> <header> <class>[,<class>...] ...args_to_compiler...\n", program_name);
+    puts("<in> and <out> are files or directories (every file of directory is converted)");
+    puts("mine writes seeds of local objects in unit tests (file or directory) to <out_dir>");
+    puts("--split is for harness generated with --split");
     return 1;
 }
 
@@ -51,14 +111,14 @@ typedef struct {
     CXCursor root_cursor;
 } ClangData;
 
-// If error index is NULL
-ClangData init_clang(const FuzzerArgs *args) {
+// Header or test file, if error index is NULL
+ClangData init_clang(const FuzzerArgs *args, const char *path) {
     ClangData d = {0, 0, 0};
 
     d.index = clang_createIndex(0, 0);
     d.translation_unit = clang_parseTranslationUnit(
         d.index,
-        args->header_path,
+        path,
         args->compiler_args,
         args->compiler_args_n,
         0,
@@ -113,207 +173,1032 @@ CXCursor find_class(ClangData d, const char *class_name) {
 
 ///////////////////////////// EXTRACT CLASS DATA /////////////////////////////
 
+// How argument bytes are written as text
+typedef enum {
+    ARG_RAW,
+    ARG_BOOL,
+    ARG_SIGNED,
+    ARG_UNSIGNED,
+    ARG_FLOAT,
+} ArgKind;
+
 typedef struct {
-    const char **arg_types;
-    size_t arg_len;
-} ConstructorInfo;
+    char *type;
+    size_t size;
+    ArgKind kind;
+} ArgInfo;
 
+// Constructors and methods alike, in order of harness tables
 typedef struct {
-    const char *name;
-    const char **arg_types;
+    char *name;
+    ArgInfo *args;
     size_t arg_len;
-} MethodInfo;
+    size_t arg_size;
+} CallInfo;
 
+// One chain of harness class_list: object chain of class or its static calls
 typedef struct {
-    const char *class_name;
-    ConstructorInfo *constructors;
+    char *class_name;
+    CallInfo *constructors;
     size_t constr_len;
-    MethodInfo *methods;
+    CallInfo *methods;
     size_t method_len;
+    // static methods and factories, moved to chains by split_chains
+    CallInfo *statics;
+    size_t static_len;
+    CallInfo *factories;
+    size_t factory_len;
+    // first type libclang couldn't size, extraction failed if set
+    char *unsized;
 } FuzgenData;
 
+void deinit_calls(CallInfo *calls, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        for (size_t j = 0; j < calls[i].arg_len; ++j)
+            free(calls[i].args[j].type);
+        free(calls[i].args);
+        free(calls[i].name);
+    }
+    free(calls);
+}
+
 void deinit(FuzgenData *d) {
-    for (size_t i = 0; i < 10; ++i) {
-        for (size_t j = 0; i < d->constr_len && j < d->constructors[i].arg_len; ++j)
-            free(d->constructors[i].arg_types[j]);
-        free(d->constructors[i].arg_types);        
-    }
-    free(d->constructors);
-    
-    for (size_t i = 0; i < 10; ++i) {
-        if (i < d->method_len)
-            free(d->methods[i].name);
-        for (size_t j = 0; i < d->method_len && j < d->methods[i].arg_len; ++j)
-            free(d->methods[i].arg_types[j]);
-        free(d->methods[i].arg_types);
-    }
-    free(d->methods);
-}
-
-CXChildVisitResult dump_class_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
-    FuzgenData *d = (FuzgenData *)client_data;
-    CXString s = clang_getCursorSpelling(parent);
-    if (strcmp(d->class_name, clang_getCString(s)))
-        return CXChildVisit_Break;
+    deinit_calls(d->constructors, d->constr_len);
+    deinit_calls(d->methods, d->method_len);
+    deinit_calls(d->statics, d->static_len);
+    deinit_calls(d->factories, d->factory_len);
+    free(d->class_name);
+    free(d->unsized);
+}
+
+ArgKind arg_kind(CXType type) {
+    switch (clang_getCanonicalType(clang_getNonReferenceType(type)).kind) {
+        case CXType_Bool:
+            return ARG_BOOL;
+        case CXType_Char_U: case CXType_UChar: case CXType_UShort:
+        case CXType_UInt: case CXType_ULong: case CXType_ULongLong:
+            return ARG_UNSIGNED;
+        case CXType_Char_S: case CXType_SChar: case CXType_Short:
+        case CXType_Int: case CXType_Long: case CXType_LongLong: case CXType_Enum:
+            return ARG_SIGNED;
+        case CXType_Float: case CXType_Double: case CXType_LongDouble:
+            return ARG_FLOAT;
+        default:
+            return ARG_RAW;
+    }
+}
+
+char *take_string(CXString s) {
+    char *copy = strdup(clang_getCString(s));
     clang_disposeString(s);
+    return copy;
+}
+
+// Append call of cursor to list, argument sizes are sizeof of their types (as harness reads them).
+// prefix goes before name (Class:: of factories)
+void add_call(CallInfo **calls, size_t *len, CXCursor cursor, const char *prefix, FuzgenData *d) {
+    *calls = realloc(*calls, (*len + 1) * sizeof(CallInfo));
+    CallInfo *cur = *calls + *len;
+    *len += 1;
+
+    CXType type = clang_getCursorType(cursor);
+    CXString name = clang_getCursorSpelling(cursor);
+    cur->name = malloc(strlen(prefix) + strlen(clang_getCString(name)) + 1);
+    sprintf(cur->name, "%s%s", prefix, clang_getCString(name));
+    clang_disposeString(name);
+    cur->arg_len = clang_getNumArgTypes(type);
+    cur->args = malloc(cur->arg_len * sizeof(ArgInfo) + 1);
+    cur->arg_size = 0;
+
+    for (size_t i = 0; i < cur->arg_len; ++i) {
+        CXType arg_type = clang_getArgType(type, i);
+        const long long size = clang_Type_getSizeOf(arg_type);
+        ArgInfo *a = cur->args + i;
+        a->type = take_string(clang_getTypeSpelling(arg_type));
+        a->size = size > 0 ? size : 0;
+        a->kind = arg_kind(arg_type);
+        cur->arg_size += a->size;
+        if (size <= 0 && !d->unsized)
+            d->unsized = strdup(a->type);
+    }
+}
+
+// Calls go to tables of harness: static methods returning class are also constructors
+void add_member(CXCursor cursor, MemberKind kind, CXCursor owner, int inherited, void *data) {
+    FuzgenData *d = (FuzgenData *)data;
+    if (kind == MEMBER_CONSTRUCTOR) {
+        add_call(&d->constructors, &d->constr_len, cursor, "", d);
+        return;
+    }
+    if (kind == MEMBER_METHOD) {
+        add_call(&d->methods, &d->method_len, cursor, "", d);
+        return;
+    }
+
+    add_call(&d->statics, &d->static_len, cursor, "", d);
+    char *ret = take_string(clang_getTypeSpelling(clang_getCursorResultType(cursor)));
+    if (returns_class(ret, d->class_name)) {
+        char prefix[1024];
+        snprintf(prefix, sizeof(prefix), "%s::", d->class_name);
+        add_call(&d->factories, &d->factory_len, cursor, prefix, d);
+    }
+    free(ret);
+}
 
-    if (clang_getCursorKind(cursor) == CXCursor_Constructor) {
-        ConstructorInfo *cur = d->constructors + d->constr_len;
-        d->constr_len++;
+FuzgenData from_class(const char *class_name, CXCursor class_cursor) {
+    FuzgenData d = {strdup(class_name), 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    visit_members(class_cursor, add_member, &d);
+    return d;
+}
+
+// Chains of class in harness order (has_object_chain and has_static_chain of main.c), returns
+// how many were added to out: object chain (constructors, then factories) if it has methods,
+// then static calls
+size_t split_chains(FuzgenData d, FuzgenData *out) {
+    size_t n = 0;
+    if (d.constr_len + d.factory_len > 0 && d.method_len > 0) {
+        FuzgenData *o = out + n++;
+        *o = d;
+        o->class_name = strdup(d.class_name);
+        o->constructors = realloc(d.constructors, (d.constr_len + d.factory_len) * sizeof(CallInfo));
+        memcpy(o->constructors + d.constr_len, d.factories, d.factory_len * sizeof(CallInfo));
+        o->constr_len = d.constr_len + d.factory_len;
+        o->statics = o->factories = 0;
+        o->static_len = o->factory_len = 0;
+        o->unsized = 0;
+        free(d.factories);
+    } else {
+        deinit_calls(d.constructors, d.constr_len);
+        deinit_calls(d.methods, d.method_len);
+        deinit_calls(d.factories, d.factory_len);
+    }
+
+    if (d.static_len > 0) {
+        FuzgenData *o = out + n++;
+        memset(o, 0, sizeof(*o));
+        o->class_name = malloc(strlen(d.class_name) + sizeof("::static"));
+        sprintf(o->class_name, "%s::static", d.class_name);
+        o->constructors = calloc(1, sizeof(CallInfo));
+        o->constructors->name = strdup(o->class_name);
+        o->constructors->args = malloc(1);
+        o->constr_len = 1;
+        o->methods = d.statics;
+        o->method_len = d.static_len;
+    }
+
+    free(d.class_name);
+    free(d.unsized);
+    return n;
+}
+
+///////////////////////////// WIRE FORMAT /////////////////////////////
 
-        CXType constructorType = clang_getCursorType(cursor);
-        cur->arg_len = clang_getNumArgTypes(constructorType);
+// Same calls in other wire format (as convert_chain of cfuzz.hpp), leftover bytes go after calls.
+// Chain has no class selector there
+void convert_chain(const FuzgenData *c, int from_split, const uint8_t *in, size_t size, uint8_t *out) {
+    size_t in_front = 0, in_back = size, out_front = 0, out_back = size;
+    const CallInfo *calls = c->constructors;
+    size_t len = c->constr_len;
+    while (in_front < in_back) {
+        const size_t arg_size = calls[in[in_front] % len].arg_size;
+        if (in_front + 1 + arg_size > in_back)
+            break;
 
-        for (size_t i = 0; i < cur->arg_len; ++i) {
-            cur->arg_types[i] = clang_getCString(clang_getTypeSpelling(clang_getArgType(constructorType, i)));
+        const uint8_t *args = in + in_front + 1;
+        if (from_split) {
+            in_back -= arg_size;
+            args = in + in_back;
+        }
+        out[out_front] = in[in_front];
+        if (from_split) {
+            memcpy(out + out_front + 1, args, arg_size);
+            out_front += 1 + arg_size;
+        } else {
+            out_back -= arg_size;
+            memcpy(out + out_back, args, arg_size);
+            out_front += 1;
         }
-    } else if (clang_getCursorKind(cursor) == CXCursor_CXXMethod) {
-        MethodInfo *cur = d->methods + d->method_len;
-        d->method_len++;
+        in_front += from_split ? 1 : 1 + arg_size;
+
+        calls = c->methods;
+        len = c->method_len;
+    }
+    memcpy(out + out_front, in + in_front, in_back - in_front);
+}
+
+///////////////////////////// COMPILE /////////////////////////////
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} Bytes;
+
+void bytes_push(Bytes *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        b->cap = b->cap ? 2 * b->cap : 256;
+        if (b->cap < b->len + len)
+            b->cap = b->len + len;
+        b->data = realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+typedef struct {
+    const char *p;
+    const char *path;
+    size_t line;
+    // first error, compilation stops there
+    char error[256];
+} Parser;
+
+int parse_fail(Parser *ps, const char *message, const char *what) {
+    if (!ps->error[0])
+        snprintf(ps->error, sizeof(ps->error), "%s:%zu: %s%s", ps->path, ps->line, message, what ? what : "");
+    return 0;
+}
+
+// Skip whitespace and // comments
+void skip_space(Parser *ps) {
+    for (;;) {
+        if (*ps->p == '\n')
+            ps->line += 1;
+        if (isspace((unsigned char)*ps->p))
+            ps->p += 1;
+        else if (ps->p[0] == '/' && ps->p[1] == '/')
+            while (*ps->p && *ps->p != '\n')
+                ps->p += 1;
+        else
+            return;
+    }
+}
+
+int expect(Parser *ps, char c) {
+    skip_space(ps);
+    if (*ps->p != c) {
+        const char what[2] = {c, 0};
+        return parse_fail(ps, "expected ", what);
+    }
+    ps->p += 1;
+    return 1;
+}
+
+// x"0a0b" of exactly size bytes (any size if size is SIZE_MAX)
+int parse_raw(Parser *ps, size_t size, Bytes *out) {
+    ps->p += 2;
+    size_t n = 0;
+    while (isxdigit((unsigned char)ps->p[0]) && isxdigit((unsigned char)ps->p[1])) {
+        const char hex[3] = {ps->p[0], ps->p[1], 0};
+        const uint8_t byte = strtoul(hex, 0, 16);
+        bytes_push(out, &byte, 1);
+        ps->p += 2;
+        n += 1;
+    }
+    if (*ps->p != '"')
+        return parse_fail(ps, "bad raw bytes", 0);
+    ps->p += 1;
+    if (size != SIZE_MAX && n != size)
+        return parse_fail(ps, "raw bytes don't match argument size", 0);
+    return 1;
+}
+
+// Little endian, low size bytes of value
+void push_le(Bytes *out, unsigned long long v, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        const uint8_t byte = i < sizeof(v) ? v >> 8 * i : 0;
+        bytes_push(out, &byte, 1);
+    }
+}
+
+int parse_arg(Parser *ps, const ArgInfo *a, Bytes *out) {
+    skip_space(ps);
+    if (ps->p[0] == 'x' && ps->p[1] == '"')
+        return parse_raw(ps, a->size, out);
 
-        cur->name = clang_getCString(clang_getCursorSpelling(cursor));
-        
-        CXType methodType = clang_getCursorType(cursor);
-        cur->arg_len = clang_getNumArgTypes(methodType);
+    if (a->kind == ARG_RAW)
+        return parse_fail(ps, "only raw bytes x\"...\" fit argument of type ", a->type);
 
-        for (size_t i = 0; i < cur->arg_len; ++i) {
-            cur->arg_types[i] = clang_getCString(clang_getTypeSpelling(clang_getArgType(methodType, i)));
+    if (a->kind == ARG_FLOAT) {
+        char *end;
+        const double v = strtod(ps->p, &end);
+        if (end == ps->p)
+            return parse_fail(ps, "expected number for ", a->type);
+        ps->p = end;
+        if (a->size == sizeof(float)) {
+            const float f = v;
+            bytes_push(out, &f, sizeof(f));
+        } else if (a->size == sizeof(double)) {
+            bytes_push(out, &v, sizeof(v));
+        } else {
+            return parse_fail(ps, "only raw bytes x\"...\" fit argument of type ", a->type);
         }
+        return 1;
     }
-    return CXChildVisit_Continue;
+
+    unsigned long long v;
+    if (strncmp(ps->p, "true", 4) == 0 && !isalnum((unsigned char)ps->p[4])) {
+        v = 1;
+        ps->p += 4;
+    } else if (strncmp(ps->p, "false", 5) == 0 && !isalnum((unsigned char)ps->p[5])) {
+        v = 0;
+        ps->p += 5;
+    } else if (ps->p[0] == '\'' && ps->p[1] && ps->p[2] == '\'') {
+        v = (unsigned char)ps->p[1];
+        ps->p += 3;
+    } else {
+        char *end;
+        errno = 0;
+        v = *ps->p == '-' ? (unsigned long long)strtoll(ps->p, &end, 0) : strtoull(ps->p, &end, 0);
+        if (end == ps->p || errno == ERANGE)
+            return parse_fail(ps, "expected integer for ", a->type);
+        ps->p = end;
+    }
+
+    // fits as signed or unsigned value of that size
+    if (a->size < sizeof(v)) {
+        const unsigned long long high = v >> (8 * a->size - 1);
+        const unsigned long long ones = ~0ull >> (8 * a->size - 1);
+        if (high > 1 && high != ones)
+            return parse_fail(ps, "value out of range of ", a->type);
+    }
+    push_le(out, v, a->size);
+    return 1;
 }
 
-FuzgenData from_class(const char *class_name, CXCursor class_cursor) {
-    FuzgenData d = {class_name, malloc(10 * sizeof(ConstructorInfo)), 0, malloc(10 * sizeof(MethodInfo)), 0};
-    for (size_t i = 0; i < 10; ++i) {
-        d.constructors[i].arg_types = malloc(10 * sizeof(const char *));
-        d.methods[i].arg_types = malloc(10 * sizeof(const char *));
+// Identifier of call, NULL on error
+const char *parse_name(Parser *ps, size_t *len) {
+    skip_space(ps);
+    const char *name = ps->p;
+    while (isalnum((unsigned char)*ps->p) || *ps->p == '_' || *ps->p == '~' || *ps->p == ':')
+        ps->p += 1;
+    *len = ps->p - name;
+    if (*len == 0) {
+        parse_fail(ps, "expected call", 0);
+        return 0;
     }
-    clang_visitChildren(class_cursor, dump_class_visitor, (CXClientData)&d);
-    return d;
+    return name;
 }
 
-///////////////////////////// WRITING FUZZER /////////////////////////////
-
-/// for debug
-void print_data(FuzgenData d) {
-    puts("--- FUZGEN DATA ---");
-    for (size_t i = 0; i < d.constr_len; ++i) {
-        puts("Contructor");
-        for (size_t j = 0; j < d.constructors[i].arg_len; ++j)
-            printf("%s", d.constructors[i].arg_types[j]);
-        puts("");
-    }
-    for (size_t i = 0; i < d.method_len; ++i) {
-        printf("Method %s\n", d.methods[i].name);
-        for (size_t j = 0; j < d.methods[i].arg_len; ++j)
-            printf("%s", d.methods[i].arg_types[j]);
-        puts("");
-    }
-}
-
-size_t getTypeSize(const char* typeName) {
-    if (strcmp(typeName, "int") == 0) {
-        return sizeof(int);
-    } else if (strcmp(typeName, "char") == 0) {
-        return sizeof(char);
-    } else if (strcmp(typeName, "float") == 0) {
-        return sizeof(float);
-    } else if (strcmp(typeName, "double") == 0) {
-        return sizeof(double);
-    } else if (strcmp(typeName, "uint") == 0) {
-        return sizeof(uint);
-    }
-    // Add more type mappings as needed
-    
-    return 0;  // Default case: type name not found
-}
-
-void sprintSizeBytes(char *s, size_t value) {
-    unsigned char* bytes = (unsigned char*)&value;
-
-    for (size_t i = 0; i < sizeof(size_t); i++) {
-        sprintf(s + strlen(s), "%02x ", bytes[i]);
-    }
-}
-
-void write_chain(const char *header_name, FuzgenData d, FILE *f) {
-    char *resulting_chain = malloc(1000 * sizeof(char));
-    resulting_chain[0] = '\0';
-    char trail;
-
-    puts("\nChoose starting constructor:");
-    for (size_t i = 0; i < d.constr_len; ++i) {
-        printf("%zu) %s(", i, d.class_name);
-        for (size_t j = 0; j + 1 < d.constructors[i].arg_len; ++j)
-            printf("%s, ", d.constructors[i].arg_types[j]);
-        if (d.constructors[i].arg_len > 0)
-            printf("%s", d.constructors[i].arg_types[d.constructors[i].arg_len - 1]);
-        puts(")");
-    }
-    
-    printf("\n> ");
-    size_t cid;
-    scanf("%zu", &cid);
-    scanf("%c", &trail);
-    
-    if (cid >= d.constr_len) {
-        puts("Error");
-        free(resulting_chain);
-        return;
+// Count arguments of call at p (after '('), to pick overload
+size_t count_args(const char *p) {
+    size_t n = 0, quoted = 0;
+    for (; *p && *p != ')'; ++p) {
+        if (*p == '"' || *p == '\'')
+            quoted = !quoted;
+        else if (!quoted && !isspace((unsigned char)*p) && n == 0)
+            n = 1;
+        else if (!quoted && *p == ',')
+            n += 1;
+    }
+    return n;
+}
+
+// Pick call by name#id or by name and argument count, SIZE_MAX if none
+size_t resolve(Parser *ps, const CallInfo *calls, size_t len, const char *name, size_t name_len) {
+    if (*ps->p == '#') {
+        char *end;
+        const size_t id = strtoul(ps->p + 1, &end, 10);
+        ps->p = end;
+        if (id < len && strlen(calls[id].name) == name_len && strncmp(calls[id].name, name, name_len) == 0)
+            return id;
+        parse_fail(ps, "no such call id", 0);
+        return SIZE_MAX;
     }
 
-    sprintSizeBytes(resulting_chain + strlen(resulting_chain), cid);
+    skip_space(ps);
+    const size_t argc = *ps->p == '(' ? count_args(ps->p + 1) : 0;
+    for (size_t id = 0; id < len; ++id)
+        if (strlen(calls[id].name) == name_len && strncmp(calls[id].name, name, name_len) == 0
+            && calls[id].arg_len == argc)
+            return id;
+
+    parse_fail(ps, "no such call ", 0);
+    snprintf(ps->error + strlen(ps->error), sizeof(ps->error) - strlen(ps->error), "%.*s/%zu", (int)name_len, name, argc);
+    return SIZE_MAX;
+}
+
+// Call id and its arguments up to ';'
+int parse_call(Parser *ps, const CallInfo *calls, size_t len, const char *name, size_t name_len, Bytes *out) {
+    const size_t id = resolve(ps, calls, len, name, name_len);
+    if (id == SIZE_MAX)
+        return 0;
+    if (id > 255)
+        return parse_fail(ps, "call id doesn't fit in byte", 0);
+
+    const uint8_t byte = id;
+    bytes_push(out, &byte, 1);
+
+    if (!expect(ps, '('))
+        return 0;
+    for (size_t i = 0; i < calls[id].arg_len; ++i) {
+        if (i > 0 && !expect(ps, ','))
+            return 0;
+        if (!parse_arg(ps, calls[id].args + i, out))
+            return 0;
+    }
+    return expect(ps, ')') && expect(ps, ';');
+}
+
+// Compile whole chain text, 0 on error (ps->error is set)
+int compile_chain(Parser *ps, FuzgenData *d, size_t class_len, int split, Bytes *out) {
+    const FuzgenData *c = 0;
+
+    for (skip_space(ps); *ps->p; skip_space(ps)) {
+        // raw bytes
+        if (ps->p[0] == 'x' && ps->p[1] == '"') {
+            if (!parse_raw(ps, SIZE_MAX, out) || !expect(ps, ';'))
+                return 0;
+            continue;
+        }
 
-    for (size_t i = 0; i < d.constructors[cid].arg_len; ++i) {
-        size_t b = getTypeSize(d.constructors[cid].arg_types[i]);
-        printf("%s (%zu bytes)> ", d.constructors[cid].arg_types[i], b);
+        size_t name_len;
+        const char *name = parse_name(ps, &name_len);
+        if (!name)
+            return 0;
 
-        for (size_t j = 0; j < b; ++j) {
-            size_t rb;
-            scanf("%c", &rb);
-            sprintf(resulting_chain + strlen(resulting_chain), "%c", rb);
+        if (c) {
+            if (!parse_call(ps, c->methods, c->method_len, name, name_len, out))
+                return 0;
+            continue;
         }
-        scanf("%c", &trail);
-    }
-
-    size_t cmd = 0;
-    while (1) {
-        puts("\nChoose next method (0 to exit):");
-        for (size_t i = 0; i < d.method_len; ++i) {
-            printf("%zu) %s(", i + 1, d.methods[i].name);
-            for (size_t j = 0; j + 1 < d.methods[i].arg_len; ++j)
-                printf("%s, ", d.methods[i].arg_types[j]);
-            if (d.methods[i].arg_len > 0)
-                printf("%s", d.methods[i].arg_types[d.methods[i].arg_len - 1]);
-            puts(")");
+
+        // constructor picks chain
+        for (size_t k = 0; k < class_len && !c; ++k)
+            for (size_t i = 0; i < d[k].constr_len && !c; ++i)
+                if (strlen(d[k].constructors[i].name) == name_len
+                    && strncmp(d[k].constructors[i].name, name, name_len) == 0)
+                    c = d + k;
+        if (!c)
+            return parse_fail(ps, "chain must start with constructor of one of classes", 0);
+        if (class_len > 1) {
+            const uint8_t selector = c - d;
+            bytes_push(out, &selector, 1);
         }
+        if (!parse_call(ps, c->constructors, c->constr_len, name, name_len, out))
+            return 0;
+    }
+
+    // compiled interleaved
+    const size_t prefix = class_len > 1;
+    if (split && c && out->len > prefix) {
+        uint8_t *tmp = malloc(out->len);
+        convert_chain(c, 0, out->data + prefix, out->len - prefix, tmp);
+        memcpy(out->data + prefix, tmp, out->len - prefix);
+        free(tmp);
+    }
+    return 1;
+}
+
+///////////////////////////// DECOMPILE /////////////////////////////
 
-        printf("> ");
-        scanf("%zu", &cmd);
-        scanf("%c", &trail);
-        if (cmd == 0)
+void print_raw(FILE *f, const uint8_t *data, size_t size) {
+    fputs("x\"", f);
+    for (size_t i = 0; i < size; ++i)
+        fprintf(f, "%02x", data[i]);
+    fputc('"', f);
+}
+
+float float_at(const uint8_t *data) {
+    float x;
+    memcpy(&x, data, sizeof(x));
+    return x;
+}
+
+double double_at(const uint8_t *data) {
+    double x;
+    memcpy(&x, data, sizeof(x));
+    return x;
+}
+
+// Same value back from parse_arg, raw bytes where text can't keep them
+void print_arg(FILE *f, const ArgInfo *a, const uint8_t *data) {
+    unsigned long long v = 0;
+    for (size_t i = 0; i < a->size && i < sizeof(v); ++i)
+        v |= (unsigned long long)data[i] << 8 * i;
+
+    if (a->kind == ARG_BOOL && a->size == 1 && v <= 1) {
+        fputs(v ? "true" : "false", f);
+    } else if (a->kind == ARG_UNSIGNED && a->size <= sizeof(v)) {
+        fprintf(f, "%llu", v);
+    } else if (a->kind == ARG_SIGNED && a->size <= sizeof(v)) {
+        const unsigned shift = 8 * (sizeof(v) - a->size);
+        fprintf(f, "%lld", (long long)(v << shift) >> shift);
+    } else if (a->kind == ARG_FLOAT && a->size == sizeof(float) && isfinite(float_at(data))) {
+        fprintf(f, "%.9g", float_at(data));
+    } else if (a->kind == ARG_FLOAT && a->size == sizeof(double) && isfinite(double_at(data))) {
+        fprintf(f, "%.17g", double_at(data));
+    } else {
+        print_raw(f, data, a->size);
+    }
+}
+
+// name#id is only needed when name and argument count don't find call
+void print_call(FILE *f, const CallInfo *calls, size_t id, const uint8_t *args) {
+    const CallInfo *c = calls + id;
+    fputs(c->name, f);
+    for (size_t i = 0; i < id; ++i)
+        if (strcmp(calls[i].name, c->name) == 0 && calls[i].arg_len == c->arg_len) {
+            fprintf(f, "#%zu", id);
             break;
-        cmd -= 1;
+        }
+
+    fputc('(', f);
+    for (size_t i = 0; i < c->arg_len; ++i) {
+        if (i > 0)
+            fputs(", ", f);
+        print_arg(f, c->args + i, args);
+        args += c->args[i].size;
+    }
+    fputs(");\n", f);
+}
+
+// Decoded as run_chain does, trailing partial call is kept as raw bytes
+void decompile_chain(const uint8_t *data, size_t size, FuzgenData *d, size_t class_len, int split, FILE *f) {
+    if (size == 0)
+        return;
+
+    const FuzgenData *c = d;
+    size_t args = 0;
+    if (class_len > 1) {
+        c = d + data[0] % class_len;
+        args += 1;
+    }
+
+    // decompiled interleaved
+    uint8_t *tmp = 0;
+    if (split) {
+        tmp = malloc(size);
+        memcpy(tmp, data, args);
+        convert_chain(c, 1, data + args, size - args, tmp + args);
+        data = tmp;
+    }
+
+    // without constructor whole input is raw, class selector too
+    const size_t id = args < size ? data[args] % c->constr_len : 0;
+    if (args >= size || args + 1 + c->constructors[id].arg_size > size) {
+        args = 0;
+    } else {
+        print_call(f, c->constructors, id, data + args + 1);
+        args += 1 + c->constructors[id].arg_size;
+
+        while (args < size) {
+            const size_t id = data[args] % c->method_len;
+            if (args + 1 + c->methods[id].arg_size > size)
+                break;
+            print_call(f, c->methods, id, data + args + 1);
+            args += 1 + c->methods[id].arg_size;
+        }
+    }
+
+    if (args < size) {
+        fputs("// truncated call\n", f);
+        print_raw(f, data + args, size - args);
+        fputs(";\n", f);
+    }
+    free(tmp);
+}
+
+///////////////////////////// FILES /////////////////////////////
+
+typedef struct {
+    size_t files;
+    size_t failed;
+} ConvertStats;
+
+// Whole file, NUL terminated, NULL on error
+char *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    const long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(len + 1);
+    *size = fread(buf, 1, len, f);
+    buf[*size] = 0;
+    fclose(f);
+    return buf;
+}
+
+void convert_file(const FuzzerArgs *args, const char *in, const char *out, FuzgenData *d, size_t class_len, ConvertStats *stats) {
+    const Mode mode = args->mode;
+    size_t size;
+    char *buf = read_file(in, &size);
+    stats->files += 1;
+    if (!buf) {
+        stats->failed += 1;
+        return;
+    }
+
+    Bytes chain = {0, 0, 0};
+    Parser ps = {buf, in, 1, ""};
+    if (mode == MODE_COMPILE && !compile_chain(&ps, d, class_len, args->split, &chain)) {
+        fprintf(stderr, "%s\n", ps.error);
+        stats->failed += 1;
+        free(buf);
+        free(chain.data);
+        return;
+    }
+
+    FILE *f = fopen(out, mode == MODE_COMPILE ? "wb" : "w");
+    if (!f) {
+        perror(out);
+        stats->failed += 1;
+    } else if (mode == MODE_COMPILE) {
+        fwrite(chain.data, 1, chain.len, f);
+        fclose(f);
+    } else {
+        decompile_chain((const uint8_t *)buf, size, d, class_len, args->split, f);
+        fclose(f);
+    }
+    free(buf);
+    free(chain.data);
+}
+
+const char *CHAIN_SUFFIX = ".chain";
+
+// Every regular file of in_dir to out_dir, named by mode
+void convert_dir(const FuzzerArgs *args, const char *in_dir, const char *out_dir, FuzgenData *d, size_t class_len, ConvertStats *stats) {
+    DIR *dir = opendir(in_dir);
+    if (!dir) {
+        perror(in_dir);
+        stats->failed += 1;
+        return;
+    }
+
+    char in[4096], out[4096];
+    const size_t suffix_len = strlen(CHAIN_SUFFIX);
+    const struct dirent *e;
+    while ((e = readdir(dir))) {
+        snprintf(in, sizeof(in), "%s/%s", in_dir, e->d_name);
+        struct stat st;
+        if (stat(in, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        const size_t len = strlen(e->d_name);
+        if (args->mode == MODE_DECOMPILE)
+            snprintf(out, sizeof(out), "%s/%s%s", out_dir, e->d_name, CHAIN_SUFFIX);
+        else if (len > suffix_len && strcmp(e->d_name + len - suffix_len, CHAIN_SUFFIX) == 0)
+            snprintf(out, sizeof(out), "%s/%.*s", out_dir, (int)(len - suffix_len), e->d_name);
+        else
+            snprintf(out, sizeof(out), "%s/%s", out_dir, e->d_name);
+        convert_file(args, in, out, d, class_len, stats);
+    }
+    closedir(dir);
+}
+
+///////////////////////////// MINE /////////////////////////////
+
+typedef struct {
+    size_t files;
+    size_t failed;
+    size_t objects;
+    size_t calls;
+    // method calls harness doesn't have (or with id over byte), calls of harness class methods
+    // on objects without chain
+    size_t skipped;
+    // arguments which aren't constant expressions
+    size_t zeroed;
+    size_t seeds;
+    size_t duplicates;
+} MineStats;
+
+// Calls of one local object of test, in source order
+typedef struct {
+    CXCursor var;
+    const FuzgenData *c;
+    // chain which calls go to, other one for pointers and references
+    size_t owner;
+    Bytes bytes;
+    size_t calls;
+} MinedChain;
+
+typedef struct {
+    FuzgenData *d;
+    size_t class_len;
+    MinedChain *chains;
+    size_t len;
+    MineStats *stats;
+} MineVisit;
+
+// FNV-1a, names seeds
+unsigned long long hash_bytes(const uint8_t *data, size_t len) {
+    unsigned long long h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Constant value of argument expression as harness reads it, zero bytes (and 0) if it isn't one
+int encode_arg(const ArgInfo *a, CXCursor expr, Bytes *out) {
+    CXEvalResult r = clang_Cursor_Evaluate(expr);
+    const CXEvalResultKind kind = r ? clang_EvalResult_getKind(r) : CXEval_UnExposed;
+    int known = (kind == CXEval_Int || kind == CXEval_Float) && a->kind != ARG_RAW;
+
+    if (known && a->kind == ARG_FLOAT) {
+        const double v = kind == CXEval_Float ? clang_EvalResult_getAsDouble(r) : clang_EvalResult_getAsLongLong(r);
+        if (a->size == sizeof(float)) {
+            const float f = v;
+            bytes_push(out, &f, sizeof(f));
+        } else if (a->size == sizeof(double)) {
+            bytes_push(out, &v, sizeof(v));
+        } else {
+            known = 0;
+        }
+    } else if (known) {
+        const long long v = kind == CXEval_Int ? clang_EvalResult_getAsLongLong(r) : (long long)clang_EvalResult_getAsDouble(r);
+        push_le(out, v, a->size);
+    }
+
+    if (!known)
+        push_le(out, 0, a->size);
+    if (r)
+        clang_EvalResult_dispose(r);
+    return known;
+}
+
+// Call id and argument bytes (missing ones are zeroed too)
+void push_call(const CallInfo *call, size_t id, CXCursor expr, Bytes *out, MineStats *stats) {
+    const uint8_t byte = id;
+    bytes_push(out, &byte, 1);
+    const int n = clang_Cursor_getNumArguments(expr);
+    for (size_t i = 0; i < call->arg_len; ++i) {
+        const int known = (int)i < n && encode_arg(call->args + i, clang_Cursor_getArgument(expr, i), out);
+        if (!known && (int)i >= n)
+            push_le(out, 0, call->args[i].size);
+        stats->zeroed += !known;
+    }
+}
+
+// Id of call declared by cursor (same name, prefix aside, and argument types), SIZE_MAX if there is none
+size_t find_call(const CallInfo *calls, size_t len, CXCursor decl, const char *prefix) {
+    char *name = take_string(clang_getCursorSpelling(decl));
+    CXType type = clang_getCursorType(decl);
+    const int arg_len = clang_getNumArgTypes(type);
+    const size_t prefix_len = strlen(prefix);
+
+    size_t found = SIZE_MAX;
+    for (size_t id = 0; id < len && id <= 255 && found == SIZE_MAX; ++id) {
+        const CallInfo *c = calls + id;
+        if (strncmp(c->name, prefix, prefix_len) != 0 || strcmp(c->name + prefix_len, name) != 0
+            || (int)c->arg_len != arg_len)
+            continue;
+        int same = 1;
+        for (int i = 0; i < arg_len && same; ++i) {
+            char *arg_type = take_string(clang_getTypeSpelling(clang_getArgType(type, i)));
+            same = strcmp(arg_type, c->args[i].type) == 0;
+            free(arg_type);
+        }
+        if (same)
+            found = id;
+    }
+    free(name);
+    return found;
+}
+
+// First constructor or factory call of chain in initializer
+typedef struct {
+    const FuzgenData *c;
+    CXCursor expr;
+    size_t id;
+    int has_call;
+} InitCall;
+
+CXChildVisitResult init_call_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
+    InitCall *i = (InitCall *)client_data;
+    if (clang_getCursorKind(cursor) != CXCursor_CallExpr)
+        return CXChildVisit_Recurse;
+
+    i->has_call = 1;
+    CXCursor decl = clang_getCursorReferenced(cursor);
+    if (clang_getCursorKind(decl) == CXCursor_Constructor) {
+        i->id = find_call(i->c->constructors, i->c->constr_len, decl, "");
+    } else if (clang_getCursorKind(decl) == CXCursor_CXXMethod) {
+        char prefix[1024];
+        snprintf(prefix, sizeof(prefix), "%s::", i->c->class_name);
+        i->id = find_call(i->c->constructors, i->c->constr_len, decl, prefix);
+    }
+    if (i->id == SIZE_MAX)
+        return CXChildVisit_Recurse;
+    i->expr = cursor;
+    return CXChildVisit_Break;
+}
+
+CXChildVisitResult first_child_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
+    *(CXCursor *)client_data = cursor;
+    return CXChildVisit_Break;
+}
+
+CXCursor first_child(CXCursor cursor) {
+    CXCursor child = clang_getNullCursor();
+    clang_visitChildren(cursor, first_child_visitor, (CXClientData)&child);
+    return child;
+}
+
+// Expression without implicit casts, parentheses and & or * operators
+CXCursor strip_expr(CXCursor e) {
+    while (!clang_Cursor_isNull(e) && (clang_getCursorKind(e) == CXCursor_UnexposedExpr
+        || clang_getCursorKind(e) == CXCursor_ParenExpr || clang_getCursorKind(e) == CXCursor_UnaryOperator))
+        e = first_child(e);
+    return e;
+}
+
+CXChildVisitResult init_expr_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
+    if (clang_isExpression(clang_getCursorKind(cursor)))
+        *(CXCursor *)client_data = cursor;
+    return CXChildVisit_Continue;
+}
+
+// Initializer of variable (type references aside), null cursor if there is none
+CXCursor init_expr(CXCursor var) {
+    CXCursor e = clang_getNullCursor();
+    clang_visitChildren(var, init_expr_visitor, (CXClientData)&e);
+    return e;
+}
+
+// Harness class with methods declared by cursor, 0 if there is none
+const FuzgenData *mined_class(MineVisit *v, CXCursor decl) {
+    if (clang_Cursor_isNull(decl))
+        return 0;
+    char *name = take_string(clang_getCursorSpelling(decl));
+    const FuzgenData *c = 0;
+    for (size_t k = 0; k < v->class_len && !c; ++k)
+        if (v->d[k].method_len > 0 && strcmp(v->d[k].class_name, name) == 0)
+            c = v->d + k;
+    free(name);
+    return c;
+}
 
-        sprintSizeBytes(resulting_chain + strlen(resulting_chain), cmd);
+// Chain which variable of expression is (or points to), SIZE_MAX if expression isn't such variable
+size_t find_chain(MineVisit *v, CXCursor e) {
+    if (clang_Cursor_isNull(e) || clang_getCursorKind(e) != CXCursor_DeclRefExpr)
+        return SIZE_MAX;
+    CXCursor var = clang_getCursorReferenced(e);
+    for (size_t i = v->len; i > 0; --i)
+        if (clang_equalCursors(v->chains[i - 1].var, var))
+            return v->chains[i - 1].owner;
+    return SIZE_MAX;
+}
+
+MinedChain *add_chain(MineVisit *v, CXCursor var, const FuzgenData *c, size_t owner) {
+    v->chains = realloc(v->chains, (v->len + 1) * sizeof(MinedChain));
+    MinedChain *m = v->chains + v->len++;
+    *m = (MinedChain){var, c, owner, {0, 0, 0}, 0};
+    return m;
+}
 
-        for (size_t i = 0; i < d.methods[cmd].arg_len; ++i) {
-            size_t b = getTypeSize(d.methods[cmd].arg_types[i]);
-            printf("%s (%zu bytes)> ", d.methods[cmd].arg_types[i], b);
+// Variable of class starts chain with call of its initializer, pointer or reference to variable
+// of chain continues it
+void start_chain(MineVisit *v, CXCursor var) {
+    CXType type = clang_getCanonicalType(clang_getCursorType(var));
+    const int indirect = type.kind == CXType_Pointer || type.kind == CXType_LValueReference
+        || type.kind == CXType_RValueReference;
+    if (indirect)
+        type = clang_getCanonicalType(clang_getPointeeType(type));
+    const FuzgenData *c = mined_class(v, clang_getTypeDeclaration(type));
+    if (!c)
+        return;
 
-            for (size_t j = 0; j < b; ++j) {
-                size_t rb;
-                scanf("%c", &rb);
-                sprintf(resulting_chain + strlen(resulting_chain), "%c", rb);
-            }
-            scanf("%c", &trail);
+    if (indirect) {
+        const size_t owner = find_chain(v, strip_expr(init_expr(var)));
+        if (owner != SIZE_MAX) {
+            add_chain(v, var, c, owner);
+            return;
         }
     }
 
-    fprintf(f, "%s", resulting_chain);
+    // without any call in initializer default constructor is implicit (not for pointers or
+    // references), objects from copies, free functions or conversions have no chain
+    InitCall init = {c, clang_getNullCursor(), SIZE_MAX, 0};
+    clang_visitChildren(var, init_call_visitor, (CXClientData)&init);
+    for (size_t id = 0; id < c->constr_len && id <= 255 && !init.has_call && !indirect; ++id)
+        if (c->constructors[id].arg_len == 0 && strcmp(c->constructors[id].name, c->class_name) == 0)
+            init.id = id;
+    if (init.id == SIZE_MAX)
+        return;
+
+    MinedChain *m = add_chain(v, var, c, v->len);
+    if (v->class_len > 1) {
+        const uint8_t selector = c - v->d;
+        bytes_push(&m->bytes, &selector, 1);
+    }
+    push_call(c->constructors + init.id, init.id, init.expr, &m->bytes, v->stats);
+    v->stats->objects += 1;
+}
+
+// Method call on variable of chain (obj.method(), ptr->method() or through reference) goes to
+// its end, method calls of harness class on other objects are skipped
+void add_method_call(MineVisit *v, CXCursor call) {
+    CXCursor member = first_child(call);
+    if (clang_Cursor_isNull(member) || clang_getCursorKind(member) != CXCursor_MemberRefExpr)
+        return;
+    CXCursor decl = clang_getCursorReferenced(call);
+    const size_t owner = find_chain(v, strip_expr(first_child(member)));
+    if (owner == SIZE_MAX) {
+        // fixture members, parameters, objects without chain
+        if (mined_class(v, clang_getCursorSemanticParent(decl)))
+            v->stats->skipped += 1;
+        return;
+    }
+
+    MinedChain *m = v->chains + owner;
+    const size_t id = find_call(m->c->methods, m->c->method_len, decl, "");
+    if (id == SIZE_MAX) {
+        v->stats->skipped += 1;
+        return;
+    }
+    push_call(m->c->methods + id, id, call, &m->bytes, v->stats);
+    m->calls += 1;
+    v->stats->calls += 1;
+}
+
+CXChildVisitResult mine_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
+    MineVisit *v = (MineVisit *)client_data;
+
+    // included headers aren't tests
+    if (!clang_Location_isFromMainFile(clang_getCursorLocation(cursor)))
+        return CXChildVisit_Continue;
+
+    if (clang_getCursorKind(cursor) == CXCursor_VarDecl)
+        start_chain(v, cursor);
+    else if (clang_getCursorKind(cursor) == CXCursor_CallExpr)
+        add_method_call(v, cursor);
+    return CXChildVisit_Recurse;
+}
+
+// Chain with at least one method call as out_dir/<hash>, in wire format of harness
+void write_seed(const FuzzerArgs *args, const char *out_dir, MinedChain *m, size_t class_len, MineStats *stats) {
+    const size_t prefix = class_len > 1;
+    if (args->split) {
+        uint8_t *tmp = malloc(m->bytes.len);
+        convert_chain(m->c, 0, m->bytes.data + prefix, m->bytes.len - prefix, tmp);
+        memcpy(m->bytes.data + prefix, tmp, m->bytes.len - prefix);
+        free(tmp);
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%016llx", out_dir, hash_bytes(m->bytes.data, m->bytes.len));
+    FILE *f = fopen(path, "wbx");
+    if (!f) {
+        if (errno == EEXIST)
+            stats->duplicates += 1;
+        else
+            perror(path);
+        return;
+    }
+    fwrite(m->bytes.data, 1, m->bytes.len, f);
+    fclose(f);
+    stats->seeds += 1;
+}
+
+void mine_file(const FuzzerArgs *args, const char *test, const char *out_dir, FuzgenData *d, size_t class_len, MineStats *stats) {
+    stats->files += 1;
+    ClangData cdata = init_clang(args, test);
+    if (!cdata.index) {
+        fprintf(stderr, "%s: parse failed\n", test);
+        stats->failed += 1;
+        return;
+    }
+
+    MineVisit v = {d, class_len, 0, 0, stats};
+    clang_visitChildren(cdata.root_cursor, mine_visitor, (CXClientData)&v);
+    for (size_t i = 0; i < v.len; ++i) {
+        if (v.chains[i].calls > 0)
+            write_seed(args, out_dir, v.chains + i, class_len, stats);
+        free(v.chains[i].bytes.data);
+    }
+    free(v.chains);
+    deinit_clang(cdata);
+}
 
-    free(resulting_chain);
+int is_source(const char *name) {
+    const char *ext = strrchr(name, '.');
+    return ext && (strcmp(ext, ".cpp") == 0 || strcmp(ext, ".cc") == 0 || strcmp(ext, ".cxx") == 0);
+}
+
+// Source files of test directory, not recursive
+void mine_dir(const FuzzerArgs *args, const char *test_dir, const char *out_dir, FuzgenData *d, size_t class_len, MineStats *stats) {
+    DIR *dir = opendir(test_dir);
+    if (!dir) {
+        perror(test_dir);
+        stats->failed += 1;
+        return;
+    }
+
+    char path[4096];
+    const struct dirent *e;
+    while ((e = readdir(dir))) {
+        snprintf(path, sizeof(path), "%s/%s", test_dir, e->d_name);
+        struct stat st;
+        if (is_source(e->d_name) && stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            mine_file(args, path, out_dir, d, class_len, stats);
+    }
+    closedir(dir);
 }
 
 ///////////////////////////// MAIN /////////////////////////////
@@ -323,21 +1208,92 @@ int main(const int argc, const char **argv) {
     if (!args.header_path)
         return usage(argv[0]);
 
-    ClangData cdata = init_clang(&args);
+    // argument sizes of template instantiations aren't known from header, and without them
+    // selector and call bytes of other classes in same harness can't be written either
+    if (strchr(args.class_name, '<')) {
+        fprintf(stderr, "Class templates aren't supported (%s), harness with them can't be coded\n", args.class_name);
+        return 1;
+    }
+
+    ClangData cdata = init_clang(&args, args.header_path);
     if (!cdata.index)
         return print_error("Error while initializing clang");
 
-    CXCursor class_cursor = find_class(cdata, args.class_name);
-    if (clang_Cursor_isNull(class_cursor))
-        return print_error("Class not found");
+    // classes are comma separated, same order as in main.c, each gives up to 2 chains
+    char *names = strdup(args.class_name);
+    size_t names_len = 1;
+    for (char *p = names; *p; ++p)
+        names_len += *p == ',';
+    FuzgenData *data = calloc(2 * names_len, sizeof(FuzgenData));
+    size_t class_len = 0;
 
-    FuzgenData data = from_class(args.class_name, class_cursor);
-    
-    FILE *file = fopen("chain", "w");
-    write_chain(args.header_path, data, file);
-    fclose(file);
+    int error = 0;
+    char *name = names;
+    for (size_t k = 0; k < names_len && !error; ++k) {
+        char *next = strchr(name, ',');
+        if (next)
+            *next = '\0';
 
-    deinit(&data);
+        CXCursor class_cursor = find_class(cdata, name);
+        if (clang_Cursor_isNull(class_cursor)) {
+            fprintf(stderr, "Class %s not found\n", name);
+            error = 1;
+            break;
+        }
+        FuzgenData d = from_class(name, class_cursor);
+        if (d.unsized) {
+            fprintf(stderr, "Class %s: size of argument type %s is unknown\n", name, d.unsized);
+            error = 1;
+        }
+        const size_t chains = split_chains(d, data + class_len);
+        if (chains == 0 && !error) {
+            fprintf(stderr, "Class %s: nothing to call\n", name);
+            error = 1;
+        }
+        class_len += chains;
+        if (next)
+            name = next + 1;
+    }
+
+    ConvertStats stats = {0, 0};
+    MineStats mined = {0, 0, 0, 0, 0, 0, 0, 0};
+    struct stat st;
+    if (error) {
+    } else if (stat(args.input, &st) != 0) {
+        perror(args.input);
+        error = 1;
+    } else if (args.mode == MODE_MINE) {
+        if (mkdir(args.output, 0755) != 0 && errno != EEXIST) {
+            perror(args.output);
+            error = 1;
+        } else if (S_ISDIR(st.st_mode)) {
+            mine_dir(&args, args.input, args.output, data, class_len, &mined);
+        } else {
+            mine_file(&args, args.input, args.output, data, class_len, &mined);
+        }
+    } else if (S_ISDIR(st.st_mode)) {
+        if (mkdir(args.output, 0755) != 0 && errno != EEXIST) {
+            perror(args.output);
+            error = 1;
+        } else {
+            convert_dir(&args, args.input, args.output, data, class_len, &stats);
+        }
+    } else {
+        convert_file(&args, args.input, args.output, data, class_len, &stats);
+    }
+
+    if (!error && args.mode == MODE_MINE)
+        fprintf(stderr, "%zu test files mined, %zu failed: %zu objects, %zu calls (%zu skipped, %zu arguments zeroed), "
+            "%zu seeds written, %zu duplicates\n", mined.files - mined.failed, mined.failed, mined.objects,
+            mined.calls, mined.skipped, mined.zeroed, mined.seeds, mined.duplicates);
+    else if (!error)
+        fprintf(stderr, "%zu files %s, %zu failed\n", stats.files - stats.failed,
+            args.mode == MODE_COMPILE ? "compiled" : "decompiled", stats.failed);
+
+    for (size_t k = 0; k < class_len; ++k)
+        deinit(data + k);
+    free(data);
+    free(names);
     deinit_clang(cdata);
-    return 0;
+    return error || stats.failed != 0 || mined.failed != 0;
 }
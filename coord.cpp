@@ -0,0 +1,480 @@
+/// Multi-process fuzzing coordinator
+///
+/// Class sources (and harness) are built with SanitizerCoverage, same as for distill.cpp:
+///   clang++ -std=c++20 -O2 -I. -fsanitize-coverage=trace-pc-guard coord.cpp <class sources> -o cfuzz_coord
+///   ./cfuzz_coord [--jobs=N] [--max-len=N] [--seconds=N] [--timeout-ms=N] [--corpus-mb=N] <corpus_dir> [<seed_dir>...]
+///
+/// Coordinator forks N workers, each runs its own loop of mutfuzz mutations and execs in process.
+/// Edge map and corpus are in shared memory: input hitting edge nobody has seen yet is
+/// appended at once, so peers pick it on their next exec instead of after filesystem sync.
+/// Hit counts of edges are bucketed (1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+) as in libFuzzer,
+/// so new bucket of known edge is coverage too.
+/// Corpus holds canonical chains (see cfuzz.hpp) deduplicated by content hash, so same
+/// chain found by several workers is kept once. On hot path worker writes only its own
+/// slots (copy of input being run, its size and counters, each on own cache lines),
+/// shared edge map is read and written only for hit buckets not seen yet.
+///
+/// Every exec runs under alarm of --timeout-ms (1000 by default, 0 disables it).
+/// Coordinator writes new inputs to corpus_dir (under content hash), inputs killing
+/// a worker to crash-<hash> (timeout-<hash> if alarm did), restarts that worker
+/// and prints stats every second.
+
+#define CFUZZ_NO_ENTRY
+#define CFUZZ_COVERAGE_HOOKS
+#define CFUZZ_MUTATE_STUB
+#include "mutfuzz.cpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+///////////////////////////// COVERAGE /////////////////////////////
+
+// Edges of current exec, recorded only while run_chain runs (mutator and loop are instrumented too)
+cfuzz::CovMap *worker_map = nullptr;
+
+// Bit of hit count bucket
+CFUZZ_NO_COVERAGE inline uint8_t hit_bucket(uint8_t hit) {
+    if (hit < 4)
+        return hit == 3 ? 4 : hit;
+    if (hit < 8)
+        return 8;
+    if (hit < 16)
+        return 16;
+    if (hit < 32)
+        return 32;
+    return hit < 128 ? 64 : 128;
+}
+
+///////////////////////////// SHARED STATE /////////////////////////////
+
+const size_t CORPUS_ENTRIES = 1 << 20;
+const size_t HASH_SLOTS = 1 << 21;
+
+// Published once bytes are in arena, entry is left empty when its chain didn't get in
+// (or worker died while writing it)
+enum EntryState : uint32_t { ENTRY_EMPTY, ENTRY_READY, ENTRY_SAVED };
+
+struct Entry {
+    uint64_t offset;
+    uint32_t size;
+    std::atomic<uint32_t> ready;  // EntryState, saved is set by coordinator
+};
+
+struct alignas(64) WorkerState {
+    std::atomic<uint64_t> execs;
+    std::atomic<uint64_t> found;
+    // input being run, read by coordinator when worker dies
+    std::atomic<uint32_t> current_size;
+};
+
+// Everything lives in one MAP_SHARED mapping made before fork:
+// header, edge map, hash set, entries, worker states and current inputs, arena
+struct Shared {
+    std::atomic<uint32_t> stop;
+    std::atomic<uint64_t> edges;
+    std::atomic<uint64_t> features;  // edge and hit bucket pairs
+    std::atomic<uint64_t> corpus_len;  // entries reserved
+    std::atomic<uint64_t> arena_used;
+    uint64_t arena_size;
+    size_t jobs;
+    size_t max_len;
+    size_t timeout_ms;
+
+    std::atomic<uint8_t> *edge_map;  // bits of hit buckets seen
+    std::atomic<uint64_t> *hashes;
+    Entry *entries;
+    WorkerState *workers;
+    uint8_t *current;
+    uint8_t *arena;
+};
+
+// Slot of input being run by worker, padded to cache line
+size_t current_stride(size_t max_len) {
+    return (max_len + 63) & ~(size_t)63;
+}
+
+Shared *shared_map(size_t jobs, size_t max_len, size_t timeout_ms, size_t arena_size) {
+    const size_t size = sizeof(Shared) + cfuzz::COV_MAP_SIZE + HASH_SLOTS * sizeof(uint64_t)
+        + CORPUS_ENTRIES * sizeof(Entry) + jobs * (sizeof(WorkerState) + current_stride(max_len)) + arena_size + 64;
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+        return nullptr;
+
+    // zero pages are valid empty state of everything
+    Shared *s = (Shared *)p;
+    uint8_t *at = (uint8_t *)(s + 1);
+    s->edge_map = (std::atomic<uint8_t> *)at;
+    at += cfuzz::COV_MAP_SIZE;
+    s->hashes = (std::atomic<uint64_t> *)at;
+    at += HASH_SLOTS * sizeof(uint64_t);
+    s->entries = (Entry *)at;
+    at += CORPUS_ENTRIES * sizeof(Entry);
+    at = (uint8_t *)(((uintptr_t)at + 63) & ~(uintptr_t)63);
+    s->workers = (WorkerState *)at;
+    at += jobs * sizeof(WorkerState);
+    s->current = at;
+    at += jobs * current_stride(max_len);
+    s->arena = at;
+    s->arena_size = arena_size;
+    s->jobs = jobs;
+    s->max_len = max_len;
+    s->timeout_ms = timeout_ms;
+    return s;
+}
+
+// 0 marks empty slot (hash 0 is moved to 1)
+bool find_hash(Shared *s, uint64_t h) {
+    h += h == 0;
+    for (size_t i = h % HASH_SLOTS, n = 0; n < HASH_SLOTS; i = (i + 1) % HASH_SLOTS, ++n) {
+        const uint64_t slot = s->hashes[i].load(std::memory_order_relaxed);
+        if (slot == 0 || slot == h)
+            return slot == h;
+    }
+    return false;
+}
+
+// true if hash wasn't there
+bool insert_hash(Shared *s, uint64_t h) {
+    h += h == 0;
+    for (size_t i = h % HASH_SLOTS, n = 0; n < HASH_SLOTS; i = (i + 1) % HASH_SLOTS, ++n) {
+        uint64_t slot = s->hashes[i].load(std::memory_order_relaxed);
+        if (slot == 0 && s->hashes[i].compare_exchange_strong(slot, h))
+            return true;
+        if (slot == h)
+            return false;
+    }
+    return false;
+}
+
+// Entry index, false if table is full
+bool reserve_entry(Shared *s, uint64_t &i) {
+    i = s->corpus_len.load(std::memory_order_relaxed);
+    do {
+        if (i >= CORPUS_ENTRIES)
+            return false;
+    } while (!s->corpus_len.compare_exchange_weak(i, i + 1));
+    return true;
+}
+
+// Arena bytes for chain, false if it doesn't fit (then nothing is taken, smaller chain may still fit)
+bool reserve_arena(Shared *s, size_t size, uint64_t &offset) {
+    offset = s->arena_used.load(std::memory_order_relaxed);
+    do {
+        if (offset + size > s->arena_size)
+            return false;
+    } while (!s->arena_used.compare_exchange_weak(offset, offset + size));
+    return true;
+}
+
+// Canonical form of input goes to corpus unless same chain is there, false if it isn't added.
+// Hash is inserted only once chain has its entry and arena bytes, so chain that doesn't fit
+// isn't marked seen (entry and bytes reserved for chain that didn't get in are left unused).
+bool corpus_add(Shared *s, const uint8_t *data, size_t size) {
+    uint8_t *chain = (uint8_t *)malloc(size + 1);
+    memcpy(chain, data, size);
+    size = canonical_chain(chain, size);
+
+    bool added = false;
+    uint64_t i, offset;
+    const uint64_t hash = cfuzz::content_hash(chain, size);
+    if (size > 0 && !find_hash(s, hash) && reserve_entry(s, i) && reserve_arena(s, size, offset)
+        && insert_hash(s, hash)) {
+        memcpy(s->arena + offset, chain, size);
+        s->entries[i].offset = offset;
+        s->entries[i].size = size;
+        s->entries[i].ready.store(ENTRY_READY, std::memory_order_release);
+        added = true;
+    }
+    free(chain);
+    return added;
+}
+
+///////////////////////////// WORKER /////////////////////////////
+
+// Newest inputs are picked half of the time, so fresh finds of peers spread at once
+const Entry *pick(Shared *s, std::mt19937 &rng) {
+    const uint64_t len = std::min<uint64_t>(s->corpus_len.load(std::memory_order_acquire), CORPUS_ENTRIES);
+    for (int tries = 0; len && tries < 4; ++tries) {
+        const uint64_t recent = std::min<uint64_t>(len, 16);
+        const uint64_t i = rng() % 2 ? len - 1 - rng() % recent : rng() % len;
+        if (s->entries[i].ready.load(std::memory_order_acquire))
+            return &s->entries[i];
+    }
+    return nullptr;
+}
+
+// Alarm of exec, SIGALRM kills worker (coordinator tells timeout by signal)
+CFUZZ_NO_COVERAGE void set_alarm(size_t ms) {
+    struct itimerval t = {};
+    t.it_value.tv_sec = ms / 1000;
+    t.it_value.tv_usec = ms % 1000 * 1000;
+    setitimer(ITIMER_REAL, &t, nullptr);
+}
+
+// Exec with coverage, new hit buckets of edges are claimed in shared map, returns their count
+CFUZZ_NO_COVERAGE size_t exec(Shared *s, size_t w, const uint8_t *data, size_t size) {
+    WorkerState &state = s->workers[w];
+    memcpy(s->current + w * current_stride(s->max_len), data, size);
+    state.current_size.store(size, std::memory_order_release);
+
+    cfuzz::CovMap *m = worker_map;
+    m->touched_len = 0;
+    if (s->timeout_ms)
+        set_alarm(s->timeout_ms);
+    cfuzz::cov_map = m;
+    run_chain(data, size);
+    cfuzz::cov_map = nullptr;
+    if (s->timeout_ms)
+        set_alarm(0);
+
+    size_t fresh = 0, edges = 0;
+    for (size_t i = 0; i < m->touched_len; ++i) {
+        const uint32_t idx = m->touched[i];
+        const uint8_t bucket = hit_bucket(m->hit[idx]);
+        m->hit[idx] = 0;
+        if (s->edge_map[idx].load(std::memory_order_relaxed) & bucket)
+            continue;
+        const uint8_t seen = s->edge_map[idx].fetch_or(bucket);
+        fresh += !(seen & bucket);
+        edges += seen == 0;
+    }
+    if (fresh) {
+        s->features.fetch_add(fresh);
+        s->edges.fetch_add(edges);
+    }
+    state.execs.store(state.execs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return fresh;
+}
+
+// Restarted worker skips seeds, one of them may be what killed it
+CFUZZ_NO_COVERAGE void run_worker(Shared *s, size_t w, bool seeds) {
+    worker_map = (cfuzz::CovMap *)calloc(1, sizeof(cfuzz::CovMap));
+    std::mt19937 rng(w * 7919 + getpid());
+    cfuzz::stub_seed(uint64_t(rng()) << 32 | rng());
+    std::vector<uint8_t> buf(s->max_len);
+
+    // seeds are run once, each by one worker, so their edges count
+    const uint64_t seed_len = seeds ? s->corpus_len.load() : 0;
+    for (uint64_t i = w; i < seed_len; i += s->jobs) {
+        const Entry &e = s->entries[i];
+        if (!e.ready.load(std::memory_order_acquire))
+            continue;
+        const size_t size = std::min<size_t>(e.size, s->max_len);
+        memcpy(buf.data(), s->arena + e.offset, size);
+        exec(s, w, buf.data(), size);
+    }
+
+    while (!s->stop.load(std::memory_order_relaxed)) {
+        // Without corpus (and now and then anyway, for classes corpus has no chain of yet)
+        // chain starts from random bytes, constructor and selectors included
+        const Entry *e = rng() % 64 ? pick(s, rng) : nullptr;
+        size_t size = std::min<size_t>(e ? e->size : 1 + rng() % 64, s->max_len);
+        if (e)
+            memcpy(buf.data(), s->arena + e->offset, size);
+        else
+            std::generate_n(buf.data(), size, std::ref(rng));
+        size = std::min(LLVMFuzzerCustomMutator(buf.data(), size, s->max_len, rng()), s->max_len);
+
+        if (exec(s, w, buf.data(), size)) {
+            if (corpus_add(s, buf.data(), size))
+                s->workers[w].found.fetch_add(1);
+        }
+    }
+    _exit(0);
+}
+
+pid_t spawn(Shared *s, size_t w, bool seeds) {
+    const pid_t pid = fork();
+    if (pid == 0)
+        run_worker(s, w, seeds);
+    return pid;
+}
+
+///////////////////////////// COORDINATOR /////////////////////////////
+
+volatile sig_atomic_t interrupted = 0;
+
+void on_interrupt(int) {
+    interrupted = 1;
+}
+
+void write_file(const char *path, const uint8_t *data, size_t size) {
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return;
+    }
+    for (size_t done = 0; done < size;) {
+        const ssize_t n = write(fd, data + done, size - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+}
+
+// Files of dir go to corpus (canonical and deduplicated)
+void load_dir(Shared *s, const char *dir_name) {
+    DIR *dir = opendir(dir_name);
+    if (!dir)
+        return;
+
+    char path[4096];
+    std::vector<uint8_t> data(s->max_len);
+    while (const dirent *e = readdir(dir)) {
+        snprintf(path, sizeof(path), "%s/%s", dir_name, e->d_name);
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            continue;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            const ssize_t n = read(fd, data.data(), data.size());
+            if (n > 0)
+                corpus_add(s, data.data(), n);
+        }
+        close(fd);
+    }
+    closedir(dir);
+}
+
+// Ready entries of [from, corpus_len) go to corpus_dir, returns how many.
+// Empty entries are passed over (they may still be written, so from stops at first of them).
+size_t save_new(Shared *s, const char *corpus_dir, uint64_t &from) {
+    const uint64_t len = s->corpus_len.load(std::memory_order_acquire);
+    char path[4096];
+    size_t saved = 0;
+    bool all_saved = true;
+    for (uint64_t i = from; i < len; ++i) {
+        Entry &e = s->entries[i];
+        const uint32_t state = e.ready.load(std::memory_order_acquire);
+        if (state == ENTRY_READY) {
+            snprintf(path, sizeof(path), "%s/%016llx", corpus_dir,
+                (unsigned long long)cfuzz::content_hash(s->arena + e.offset, e.size));
+            write_file(path, s->arena + e.offset, e.size);
+            e.ready.store(ENTRY_SAVED, std::memory_order_relaxed);
+            saved += 1;
+        }
+        all_saved &= state != ENTRY_EMPTY;
+        if (all_saved)
+            from = i + 1;
+    }
+    return saved;
+}
+
+int main(int argc, char **argv) {
+    size_t jobs = sysconf(_SC_NPROCESSORS_ONLN), max_len = 4096, timeout_ms = 1000, corpus_mb = 256;
+    double seconds = 0;
+    int opt = 1;
+    for (; opt < argc && strncmp(argv[opt], "--", 2) == 0; ++opt) {
+        if (strncmp(argv[opt], "--jobs=", 7) == 0)
+            jobs = strtoul(argv[opt] + 7, nullptr, 10);
+        else if (strncmp(argv[opt], "--max-len=", 10) == 0)
+            max_len = strtoul(argv[opt] + 10, nullptr, 10);
+        else if (strncmp(argv[opt], "--seconds=", 10) == 0)
+            seconds = strtod(argv[opt] + 10, nullptr);
+        else if (strncmp(argv[opt], "--timeout-ms=", 13) == 0)
+            timeout_ms = strtoul(argv[opt] + 13, nullptr, 10);
+        else if (strncmp(argv[opt], "--corpus-mb=", 12) == 0)
+            corpus_mb = strtoul(argv[opt] + 12, nullptr, 10);
+        else
+            break;
+    }
+    if (argc - opt < 1 || strncmp(argv[opt], "--", 2) == 0) {
+        printf("Usage: %s [--jobs=N] [--max-len=N] [--seconds=N] [--timeout-ms=N] [--corpus-mb=N] <corpus_dir> [<seed_dir>...]\n",
+            argv[0]);
+        return 1;
+    }
+    if (jobs == 0)
+        jobs = 1;
+    if (max_len == 0)
+        max_len = 1;
+
+    const char *corpus_dir = argv[opt];
+    if (mkdir(corpus_dir, 0755) != 0 && errno != EEXIST) {
+        perror(corpus_dir);
+        return 1;
+    }
+
+    Shared *s = shared_map(jobs, max_len, timeout_ms, corpus_mb << 20);
+    if (!s) {
+        perror("mmap");
+        return 1;
+    }
+    load_dir(s, corpus_dir);
+    for (int i = opt + 1; i < argc; ++i)
+        load_dir(s, argv[i]);
+    // what was in corpus_dir is there already
+    uint64_t save_from = 0;
+    size_t saved = save_new(s, corpus_dir, save_from);
+
+    signal(SIGINT, on_interrupt);
+    signal(SIGTERM, on_interrupt);
+
+    std::vector<pid_t> pids(jobs);
+    for (size_t w = 0; w < jobs; ++w)
+        pids[w] = spawn(s, w, true);
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+    size_t crashes = 0, timeouts = 0;
+    uint64_t last_execs = 0;
+    while (!interrupted && (seconds == 0 || elapsed() < seconds)) {
+        sleep(1);
+
+        // dead worker leaves its input behind, it is saved and worker restarted
+        int status;
+        for (pid_t pid; (pid = waitpid(-1, &status, WNOHANG)) > 0;) {
+            for (size_t w = 0; w < jobs; ++w) {
+                if (pids[w] != pid)
+                    continue;
+                const uint8_t *data = s->current + w * current_stride(max_len);
+                const size_t size = s->workers[w].current_size.load(std::memory_order_acquire);
+                const bool timeout = WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM;
+                char path[64];
+                snprintf(path, sizeof(path), "%s-%016llx", timeout ? "timeout" : "crash",
+                    (unsigned long long)cfuzz::content_hash(data, size));
+                write_file(path, data, size);
+                fprintf(stderr, "worker %zu died (%s %d), input saved to %s\n", w,
+                    WIFSIGNALED(status) ? "signal" : "exit", WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status),
+                    path);
+                (timeout ? timeouts : crashes) += 1;
+                pids[w] = spawn(s, w, false);
+            }
+        }
+
+        saved += save_new(s, corpus_dir, save_from);
+
+        uint64_t execs = 0;
+        for (size_t w = 0; w < jobs; ++w)
+            execs += s->workers[w].execs.load(std::memory_order_relaxed);
+        fprintf(stderr, "#%llu edges: %llu features: %llu corpus: %llu exec/s: %llu crashes: %zu timeouts: %zu\n",
+            (unsigned long long)execs, (unsigned long long)s->edges.load(), (unsigned long long)s->features.load(),
+            (unsigned long long)saved, (unsigned long long)(execs - last_execs), crashes, timeouts);
+        last_execs = execs;
+    }
+
+    s->stop.store(1);
+    for (size_t w = 0; w < jobs; ++w)
+        waitpid(pids[w], nullptr, 0);
+    saved += save_new(s, corpus_dir, save_from);
+
+    uint64_t execs = 0, found = 0;
+    for (size_t w = 0; w < jobs; ++w) {
+        execs += s->workers[w].execs.load();
+        found += s->workers[w].found.load();
+    }
+    fprintf(stderr, "%zu workers: %llu execs, %llu edges, %llu features, %llu new inputs, corpus %llu, %zu crashes, %zu timeouts\n",
+        jobs, (unsigned long long)execs, (unsigned long long)s->edges.load(), (unsigned long long)s->features.load(),
+        (unsigned long long)found, (unsigned long long)saved, crashes, timeouts);
+    return 0;
+}
@@ -0,0 +1,173 @@
+/// Corpus canonicalization and deduplication
+///
+/// Built together with generated fuzzer.cpp and class sources:
+///   c++ -std=c++20 -I. corpus.cpp <class sources> -o cfuzz_corpus
+///   ./cfuzz_corpus <out_dir> <corpus_dir>...
+///
+/// Every input is rewritten to canonical form (see cfuzz.hpp) and written to out_dir
+/// under its content hash, so inputs running same chain end up as one file. Inputs without
+/// any complete call are dropped.
+/// Files already in out_dir count as seen, so it can be run again on new inputs.
+
+#define CFUZZ_NO_ENTRY
+#include "fuzzer.cpp"
+
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Open addressing set of hashes, 0 marks empty slot (hash 0 is moved to 1)
+struct HashSet {
+    uint64_t *slots = nullptr;
+    size_t cap = 0;
+    size_t len = 0;
+
+    // true if it wasn't there
+    bool insert(uint64_t h) {
+        h += h == 0;
+        if (2 * (len + 1) > cap)
+            grow();
+        size_t i = h & (cap - 1);
+        for (; slots[i] != 0; i = (i + 1) & (cap - 1))
+            if (slots[i] == h)
+                return false;
+        slots[i] = h;
+        len += 1;
+        return true;
+    }
+
+    void grow() {
+        uint64_t *old = slots;
+        const size_t old_cap = cap;
+        cap = cap ? 2 * cap : 1024;
+        slots = (uint64_t *)calloc(cap, sizeof(uint64_t));
+        len = 0;
+        for (size_t i = 0; i < old_cap; ++i)
+            if (old[i] != 0)
+                insert(old[i]);
+        free(old);
+    }
+};
+
+struct CorpusStats {
+    size_t files;
+    size_t unique;
+    // canonical form without any call, nothing to write
+    size_t empty;
+    size_t bytes_in;
+    size_t bytes_out;
+};
+
+// Write canonical input as out_dir/<hash> unless it was already seen or is empty
+void add_input(const char *out_dir, uint8_t *data, size_t size, HashSet &seen, CorpusStats &stats) {
+    size = canonical_chain(data, size);
+    if (size == 0) {
+        stats.empty += 1;
+        return;
+    }
+    const uint64_t h = cfuzz::content_hash(data, size);
+    if (!seen.insert(h))
+        return;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%016llx", out_dir, (unsigned long long)h);
+    const int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        if (errno != EEXIST)
+            perror(path);
+        return;
+    }
+    for (size_t done = 0; done < size;) {
+        const ssize_t n = write(fd, data + done, size - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+
+    stats.unique += 1;
+    stats.bytes_out += size;
+}
+
+// Hashes of inputs written by earlier runs are their names
+void load_seen(const char *out_dir, HashSet &seen) {
+    DIR *dir = opendir(out_dir);
+    if (!dir)
+        return;
+    while (const dirent *e = readdir(dir)) {
+        char *end;
+        const uint64_t h = strtoull(e->d_name, &end, 16);
+        if (*end == '\0' && end - e->d_name == 16)
+            seen.insert(h);
+    }
+    closedir(dir);
+}
+
+// Files are mapped privately, so canonicalization in place doesn't touch them
+void process_dir(const char *in_dir, const char *out_dir, HashSet &seen, CorpusStats &stats) {
+    DIR *dir = opendir(in_dir);
+    if (!dir) {
+        perror(in_dir);
+        return;
+    }
+
+    char path[4096];
+    while (const dirent *e = readdir(dir)) {
+        snprintf(path, sizeof(path), "%s/%s", in_dir, e->d_name);
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            continue;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            continue;
+        }
+
+        stats.files += 1;
+        stats.bytes_in += st.st_size;
+        if (st.st_size == 0) {
+            stats.empty += 1;
+            close(fd);
+            continue;
+        }
+
+        void *p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            perror(path);
+            continue;
+        }
+        add_input(out_dir, (uint8_t *)p, st.st_size, seen, stats);
+        munmap(p, st.st_size);
+    }
+    closedir(dir);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: %s <out_dir> <corpus_dir>...\n", argv[0]);
+        return 1;
+    }
+    const char *out_dir = argv[1];
+    if (mkdir(out_dir, 0755) != 0 && errno != EEXIST) {
+        perror(out_dir);
+        return 1;
+    }
+
+    HashSet seen;
+    load_seen(out_dir, seen);
+    const size_t existing = seen.len;
+
+    CorpusStats stats = {};
+    for (int i = 2; i < argc; ++i)
+        process_dir(argv[i], out_dir, seen, stats);
+
+    fprintf(stderr, "%zu files (%zu bytes) -> %zu new canonical inputs (%zu bytes), %zu empty, %zu were already there\n",
+        stats.files, stats.bytes_in, stats.unique, stats.bytes_out, stats.empty, existing);
+    free(seen.slots);
+    return 0;
+}
@@ -0,0 +1,370 @@
+/// Coverage based corpus distillation
+///
+/// Class sources (and harness) are built with SanitizerCoverage, tool collects
+/// edges of every input in process and keeps smallest set of inputs covering them all:
+///   clang++ -std=c++20 -I. -fsanitize-coverage=trace-pc-guard distill.cpp <class sources> -o cfuzz_distill
+///   ./cfuzz_distill [--jobs=N] <out_dir> <corpus_dir>...
+/// (gcc has only -fsanitize-coverage=trace-pc, it works too with pc hashed into map)
+///
+/// Inputs run in --jobs=N forked processes, input crashing one is reported with its path
+/// and left out, and the rest of its shard goes on in new process.
+///
+/// Inputs are canonicalized first (see cfuzz.hpp), and every prefix of chain cut
+/// at call boundary is candidate too. Cover is greedy weighted: input with most
+/// new edges per its cost is taken, cost grows with chain length, so short chains
+/// (and prefixes) win over long ones covering same edges.
+
+#define CFUZZ_NO_ENTRY
+#define CFUZZ_COVERAGE_HOOKS
+#include "fuzzer.cpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iterator>
+#include <queue>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+///////////////////////////// INPUTS /////////////////////////////
+
+struct Input {
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> edges;
+    uint64_t cycles;
+    std::string path;  // of prefix is path of its chain
+    bool prefix;
+};
+
+// Inputs are canonicalized while read
+void read_dir(const char *in_dir, std::vector<Input> &inputs) {
+    DIR *dir = opendir(in_dir);
+    if (!dir) {
+        perror(in_dir);
+        return;
+    }
+
+    char path[4096];
+    while (const dirent *e = readdir(dir)) {
+        snprintf(path, sizeof(path), "%s/%s", in_dir, e->d_name);
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            continue;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            continue;
+        }
+
+        Input in;
+        in.data.resize(st.st_size);
+        size_t done = 0;
+        while (done < in.data.size()) {
+            const ssize_t n = read(fd, in.data.data() + done, in.data.size() - done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        close(fd);
+
+        in.data.resize(canonical_chain(in.data.data(), done));
+        in.cycles = 0;
+        in.path = path;
+        in.prefix = false;
+        inputs.push_back(std::move(in));
+    }
+    closedir(dir);
+}
+
+///////////////////////////// PREFIXES /////////////////////////////
+
+// Whole calls of chain from its front (in split wire: ids from front and their
+// arguments from back), head is class and worker selector
+template <const auto &constr_list, const auto &method_list>
+void chain_prefixes(const Input &in, size_t head, std::vector<Input> &out) {
+    const uint8_t *data = in.data.data() + head;
+    const size_t size = in.data.size() - head;
+    cfuzz::ChainReader<split_wire> chain(data, size);
+    cfuzz::Call call;
+    // last call ends at front == back, that is whole chain
+    for (bool ok = chain.template next<constr_list>(call); ok && chain.front < chain.back;
+         ok = chain.template next<method_list>(call)) {
+        Input p;
+        p.data.assign(in.data.begin(), in.data.begin() + head + chain.front);
+        p.data.insert(p.data.end(), data + chain.back, data + size);
+        p.cycles = 0;
+        p.path = in.path;
+        p.prefix = true;
+        out.push_back(std::move(p));
+    }
+}
+
+#define CHAIN_PREFIXES(ns) chain_prefixes<ns::constr_list, ns::method_list>,
+void (*const class_prefixes[])(const Input &, size_t, std::vector<Input> &) = {
+    CFUZZ_CLASSES(CHAIN_PREFIXES)
+};
+#undef CHAIN_PREFIXES
+
+///////////////////////////// SHARDS /////////////////////////////
+
+// Shard k takes every jobs-th input. Its process appends record of each input to file:
+// index, edge count, cycles (low and high half) and edges.
+const size_t RECORD_HEAD = 4;
+
+void write_all(int fd, const void *data, size_t size) {
+    for (size_t done = 0; done < size;) {
+        const ssize_t n = write(fd, (const uint8_t *)data + done, size - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+}
+
+// Runs in shard process from input first on
+CFUZZ_NO_COVERAGE void run_shard(const std::vector<Input> &inputs, size_t first, size_t jobs, int fd) {
+    cfuzz::CovMap *m = (cfuzz::CovMap *)calloc(1, sizeof(cfuzz::CovMap));
+    std::vector<uint32_t> record;
+    for (size_t i = first; i < inputs.size(); i += jobs) {
+        const Input &in = inputs[i];
+        m->touched_len = 0;
+        const uint64_t start = cfuzz::now();
+        cfuzz::cov_map = m;
+        run_chain(in.data.data(), in.data.size());
+        cfuzz::cov_map = nullptr;
+        const uint64_t cycles = cfuzz::now() - start;
+
+        // (vector code below is instrumented too, so map is off while record is built)
+        record.assign({uint32_t(i), uint32_t(m->touched_len), uint32_t(cycles), uint32_t(cycles >> 32)});
+        record.insert(record.end(), m->touched, m->touched + m->touched_len);
+        write_all(fd, record.data(), record.size() * sizeof(uint32_t));
+        for (size_t j = 0; j < m->touched_len; ++j)
+            m->hit[m->touched[j]] = 0;
+    }
+    free(m);
+}
+
+struct Shard {
+    pid_t pid;
+    int fd;
+    size_t next;  // next input to run
+    off_t read;  // records before this are taken
+};
+
+void spawn_shard(const std::vector<Input> &inputs, size_t jobs, Shard &s) {
+    s.pid = fork();
+    if (s.pid == 0) {
+        run_shard(inputs, s.next, jobs, s.fd);
+        _exit(0);
+    }
+}
+
+// Takes complete records written since last time, partial record at end is cut off
+void take_records(std::vector<Input> &inputs, size_t jobs, Shard &s) {
+    struct stat st;
+    if (fstat(s.fd, &st) != 0 || st.st_size <= s.read)
+        return;
+    std::vector<uint32_t> words((st.st_size - s.read) / sizeof(uint32_t));
+    const ssize_t n = pread(s.fd, words.data(), words.size() * sizeof(uint32_t), s.read);
+    const size_t len = n > 0 ? n / sizeof(uint32_t) : 0;
+
+    size_t at = 0;
+    while (at + RECORD_HEAD <= len && at + RECORD_HEAD + words[at + 1] <= len) {
+        Input &in = inputs[words[at]];
+        in.cycles = words[at + 2] | uint64_t(words[at + 3]) << 32;
+        in.edges.assign(words.begin() + at + RECORD_HEAD, words.begin() + at + RECORD_HEAD + words[at + 1]);
+        s.next = words[at] + jobs;
+        at += RECORD_HEAD + words[at + 1];
+    }
+    s.read += at * sizeof(uint32_t);
+    if (ftruncate(s.fd, s.read) == 0)
+        lseek(s.fd, s.read, SEEK_SET);
+}
+
+// Runs all inputs, returns number of inputs that crashed
+size_t run_shards(std::vector<Input> &inputs, size_t jobs) {
+    std::vector<Shard> shards(jobs);
+    size_t running = 0, crashes = 0;
+    for (size_t k = 0; k < jobs; ++k) {
+        FILE *records = tmpfile();
+        if (!records) {
+            perror("tmpfile");
+            exit(1);
+        }
+        shards[k] = {-1, fileno(records), k, 0};
+        if (k < inputs.size()) {
+            spawn_shard(inputs, jobs, shards[k]);
+            running += 1;
+        }
+    }
+
+    while (running > 0) {
+        int status;
+        const pid_t pid = wait(&status);
+        if (pid < 0)
+            break;
+        for (Shard &s : shards) {
+            if (s.pid != pid)
+                continue;
+            s.pid = -1;
+            running -= 1;
+            take_records(inputs, jobs, s);
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                break;
+
+            // input after last record killed process, shard goes on past it
+            crashes += 1;
+            const Input &in = inputs[s.next];
+            fprintf(stderr, "crash in %s%s (%s %d), left out\n", in.prefix ? "prefix of " : "", in.path.c_str(),
+                WIFSIGNALED(status) ? "signal" : "exit status",
+                WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status));
+            s.next += jobs;
+            if (s.next < inputs.size()) {
+                spawn_shard(inputs, jobs, s);
+                running += 1;
+            }
+            break;
+        }
+    }
+
+    return crashes;
+}
+
+///////////////////////////// SET COVER /////////////////////////////
+
+// Each exec costs on top of its bytes
+const double EXEC_COST = 16;
+
+double input_cost(const Input &in) {
+    return EXEC_COST + in.data.size();
+}
+
+// Lazy greedy: gain of input only drops as edges get covered, so stale score
+// in queue is upper bound and input is taken once its fresh score is still on top
+std::vector<size_t> greedy_cover(const std::vector<Input> &inputs) {
+    std::vector<uint8_t> covered(cfuzz::COV_MAP_SIZE);
+    std::priority_queue<std::pair<double, size_t>> queue;
+    for (size_t i = 0; i < inputs.size(); ++i)
+        if (!inputs[i].edges.empty())
+            queue.push({inputs[i].edges.size() / input_cost(inputs[i]), i});
+
+    std::vector<size_t> chosen;
+    while (!queue.empty()) {
+        const size_t i = queue.top().second;
+        queue.pop();
+
+        size_t gain = 0;
+        for (uint32_t e : inputs[i].edges)
+            gain += !covered[e];
+        if (gain == 0)
+            continue;
+
+        const double score = gain / input_cost(inputs[i]);
+        if (!queue.empty() && score < queue.top().first) {
+            queue.push({score, i});
+            continue;
+        }
+
+        for (uint32_t e : inputs[i].edges)
+            covered[e] = 1;
+        chosen.push_back(i);
+    }
+    return chosen;
+}
+
+///////////////////////////// MAIN /////////////////////////////
+
+void write_input(const char *out_dir, const std::vector<uint8_t> &data) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%016llx", out_dir,
+        (unsigned long long)cfuzz::content_hash(data.data(), data.size()));
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return;
+    }
+    for (size_t done = 0; done < data.size();) {
+        const ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    int opt = 1;
+    size_t jobs = std::thread::hardware_concurrency();
+    for (; opt < argc && strncmp(argv[opt], "--", 2) == 0; ++opt) {
+        if (strncmp(argv[opt], "--jobs=", 7) == 0)
+            jobs = strtoul(argv[opt] + 7, nullptr, 10);
+        else
+            break;
+    }
+    if (argc - opt < 2 || strncmp(argv[opt], "--", 2) == 0) {
+        printf("Usage: %s [--jobs=N] <out_dir> <corpus_dir>...\n", argv[0]);
+        return 1;
+    }
+    if (jobs == 0)
+        jobs = 1;
+
+    const char *out_dir = argv[opt];
+    if (mkdir(out_dir, 0755) != 0 && errno != EEXIST) {
+        perror(out_dir);
+        return 1;
+    }
+
+    std::vector<Input> inputs;
+    for (int i = opt + 1; i < argc; ++i)
+        read_dir(argv[i], inputs);
+
+    // Inputs are canonical, so their prefixes are too
+    std::vector<Input> prefixes;
+    const size_t head = class_selector + worker_selector;
+    for (const Input &in : inputs)
+        if (in.data.size() > head)
+            class_prefixes[class_selector ? in.data[0] : 0](in, head, prefixes);
+    inputs.insert(inputs.end(), std::make_move_iterator(prefixes.begin()), std::make_move_iterator(prefixes.end()));
+
+    // Same canonical chain runs once (prefix equal to input is left out)
+    const auto by_data = [](const Input &a, const Input &b) { return a.data < b.data; };
+    const auto same_data = [](const Input &a, const Input &b) { return a.data == b.data; };
+    std::stable_sort(inputs.begin(), inputs.end(), by_data);
+    inputs.erase(std::unique(inputs.begin(), inputs.end(), same_data), inputs.end());
+
+    const size_t crashes = run_shards(inputs, jobs);
+
+    const std::vector<size_t> chosen = greedy_cover(inputs);
+    for (size_t i : chosen)
+        write_input(out_dir, inputs[i].data);
+
+    size_t count_in = 0, bytes_in = 0, bytes_out = 0, prefixes_out = 0, edges = 0;
+    uint64_t cycles_in = 0, cycles_out = 0;
+    std::vector<uint8_t> covered(cfuzz::COV_MAP_SIZE);
+    for (const Input &in : inputs) {
+        if (in.prefix)
+            continue;
+        count_in += 1;
+        bytes_in += in.data.size();
+        cycles_in += in.cycles;
+    }
+    for (size_t i : chosen) {
+        prefixes_out += inputs[i].prefix;
+        bytes_out += inputs[i].data.size();
+        cycles_out += inputs[i].cycles;
+        for (uint32_t e : inputs[i].edges) {
+            edges += !covered[e];
+            covered[e] = 1;
+        }
+    }
+
+    fprintf(stderr, "%zu inputs (%zu bytes, %llu cycles), %zu prefixes -> %zu inputs (%zu bytes, %llu cycles, %zu prefixes), %zu edges, %zu crashes\n",
+        count_in, bytes_in, (unsigned long long)cycles_in, inputs.size() - count_in,
+        chosen.size(), bytes_out, (unsigned long long)cycles_out, prefixes_out, edges, crashes);
+    return 0;
+}
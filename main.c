@@ -2,36 +2,131 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/resource.h>
 #include <clang-c/Index.h>
+#include "classdata.h"
 
 typedef enum CXChildVisitResult CXChildVisitResult;
 
 ///////////////////////////// PARSE ARGS /////////////////////////////
 
+typedef enum {
+    BACKEND_LIBFUZZER,
+    BACKEND_AFL,
+} Backend;
+
+typedef enum {
+    STATS_NONE,
+    STATS_TEXT,
+    STATS_JSON,
+} StatsFormat;
+
 typedef struct {
     const char *header_path;
     const char *class_name;
     const char **compiler_args;
     const int compiler_args_n;
+    Backend backend;
+    const char *output;
+    int force;
+    StatsFormat stats;
+    const char *model;
+    // "<impl_a>,<impl_b>" namespaces for differential harness
+    const char *diff;
+    // threads of concurrent harness, 0 for serial one
+    size_t workers;
+    // split wire format
+    int split;
+    // positional args are models instead of header and classes
+    int from_model;
+    const char **models;
+    int models_n;
 } FuzzerArgs;
 
 // If error all FuzzerArgs null
 FuzzerArgs parse_args(const int argc, const char **argv) {
-    FuzzerArgs args = {0, 0, 0, argc - 3};
+    // options go before header
+    int opt = 1;
+    Backend backend = BACKEND_LIBFUZZER;
+    const char *output = "fuzzer.cpp";
+    int force = 0;
+    StatsFormat stats = STATS_NONE;
+    const char *model = 0;
+    int from_model = 0;
+    const char *diff = 0;
+    size_t workers = 0;
+    int split = 0;
+    for (; opt < argc && strncmp(argv[opt], "--", 2) == 0; ++opt) {
+        if (strcmp(argv[opt], "--afl") == 0)
+            backend = BACKEND_AFL;
+        else if (strncmp(argv[opt], "--out=", 6) == 0)
+            output = argv[opt] + 6;
+        else if (strcmp(argv[opt], "--force") == 0)
+            force = 1;
+        else if (strcmp(argv[opt], "--stats") == 0)
+            stats = STATS_TEXT;
+        else if (strcmp(argv[opt], "--stats=json") == 0)
+            stats = STATS_JSON;
+        else if (strncmp(argv[opt], "--model=", 8) == 0)
+            model = argv[opt] + 8;
+        else if (strcmp(argv[opt], "--from-model") == 0)
+            from_model = 1;
+        else if (strncmp(argv[opt], "--diff=", 7) == 0 && strchr(argv[opt] + 7, ','))
+            diff = argv[opt] + 7;
+        else if (strncmp(argv[opt], "--concurrent=", 13) == 0 && atoi(argv[opt] + 13) > 0)
+            workers = atoi(argv[opt] + 13);
+        else if (strcmp(argv[opt], "--split") == 0)
+            split = 1;
+        else {
+            FuzzerArgs error = {0};
+            return error;
+        }
+    }
+
+    FuzzerArgs args = {0, 0, 0, argc - opt - 2, backend, output, force, stats, model, diff, workers, split, from_model, 0, 0};
+
+    // differential harness is serial
+    if (diff && workers) {
+        FuzzerArgs error = {0};
+        return error;
+    }
+
+    if (from_model) {
+        args.models = argv + opt;
+        args.models_n = argc - opt;
+        return args;
+    }
 
-    if (argc < 3)
+    if (argc - opt < 2)
         return args;
 
-    args.header_path = argv[1];
-    args.class_name = argv[2];
-    args.compiler_args = argv + 3;
+    args.header_path = argv[opt];
+    args.class_name = argv[opt + 1];
+    args.compiler_args = argv + opt + 2;
 
     return args;
 }
 
 // Print usage and return error code
 int usage(const char *program_name) {
-    printf("Usage: %s <header> <class> ...args_to_compiler...\n", program_name);
+    printf("Usage: %s [options] <header> <class>[,<class>...] ...args_to_compiler...\n", program_name);
+    printf("       %s [options] --from-model <model>...\n", program_name);
+    puts("Options:");
+    puts("  --afl          emit AFL++ persistent mode main instead of libFuzzer entry point");
+    puts("  --out=<file>   output file, fuzzer.cpp by default");
+    puts("  --force        write output even if class signature didn't change");
+    puts("  --stats[=json] print time of each phase, AST nodes visited, sizes and peak RSS to stderr");
+    puts("  --diff=<a>,<b> differential harness: run each chain on a::<class> and b::<class>");
+    puts("                 and abort on first different return value");
+    puts("  --concurrent=K concurrent harness: leading byte of chain deals method calls");
+    puts("                 to K threads sharing object (build with TSan)");
+    puts("  --split        split wire format: call ids from front of input, arguments from back");
+    puts("  --model=<base> also save extracted classes to <base>.yaml and <base>.cfm");
+    puts("  --from-model   render from saved models without libclang, each to <model>.cpp");
+    puts("                 (or --out if there is only one)");
     return 1;
 }
 
@@ -41,6 +136,87 @@ int print_error(const char *message) {
     return 1;
 }
 
+// Names are built in fixed buffers: cut identifier would compile to wrong code, so it is fatal
+void name_too_long(const char *name, size_t size) {
+    fprintf(stderr, "Name too long for %zu byte buffer: %.64s...\n", size, name);
+    exit(1);
+}
+
+void format_name(char *out, size_t size, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    const int len = vsnprintf(out, size, format, ap);
+    va_end(ap);
+    if (len < 0 || (size_t)len >= size)
+        name_too_long(out, size);
+}
+
+///////////////////////////// STATS /////////////////////////////
+
+// Summed over all classes of invocation
+typedef struct {
+    // seconds
+    double parse;
+    double load;
+    double find;
+    double extract;
+    double write;
+    double total;
+
+    size_t ast_nodes;
+    size_t classes;
+    size_t constructors;
+    size_t methods;
+    size_t bytes;
+    size_t written;
+    size_t up_to_date;
+} GenStats;
+
+GenStats stats;
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// In KiB
+long peak_rss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void print_stats(StatsFormat format) {
+    if (format == STATS_JSON) {
+        fprintf(stderr,
+            "{\"parse_s\": %.6f, \"load_s\": %.6f, \"find_class_s\": %.6f, \"extract_s\": %.6f, \"write_s\": %.6f, "
+            "\"total_s\": %.6f, \"ast_nodes\": %zu, \"classes\": %zu, \"constructors\": %zu, "
+            "\"methods\": %zu, \"bytes\": %zu, \"written\": %zu, \"up_to_date\": %zu, "
+            "\"peak_rss_kb\": %ld}\n",
+            stats.parse, stats.load, stats.find, stats.extract, stats.write, stats.total,
+            stats.ast_nodes, stats.classes, stats.constructors, stats.methods,
+            stats.bytes, stats.written, stats.up_to_date, peak_rss()
+        );
+        return;
+    }
+
+    fprintf(stderr, "--- CFUZZ STATS ---\n");
+    fprintf(stderr, "parse         %10.6f s\n", stats.parse);
+    fprintf(stderr, "load model    %10.6f s\n", stats.load);
+    fprintf(stderr, "find_class    %10.6f s\n", stats.find);
+    fprintf(stderr, "extract       %10.6f s\n", stats.extract);
+    fprintf(stderr, "write         %10.6f s\n", stats.write);
+    fprintf(stderr, "total         %10.6f s\n", stats.total);
+    fprintf(stderr, "ast nodes     %10zu\n", stats.ast_nodes);
+    fprintf(stderr, "classes       %10zu\n", stats.classes);
+    fprintf(stderr, "constructors  %10zu\n", stats.constructors);
+    fprintf(stderr, "methods       %10zu\n", stats.methods);
+    fprintf(stderr, "emitted       %10zu bytes (%zu written, %zu up to date)\n",
+        stats.bytes, stats.written, stats.up_to_date);
+    fprintf(stderr, "peak rss      %10ld KiB\n", peak_rss());
+}
+
 ///////////////////////////// SETUP CLANG /////////////////////////////
 
 typedef struct {
@@ -86,12 +262,18 @@ typedef struct {
     CXCursor cursor;
 } ClangClassInfo;
 
+// "RingBuf<int, 64>" names explicit instantiation of class template RingBuf
 CXChildVisitResult class_search_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
-    if (clang_getCursorKind(cursor) == CXCursor_ClassDecl) {
+    stats.ast_nodes++;
+    ClangClassInfo *i = (ClangClassInfo * )client_data;
+    const char *args = strchr(i->name, '<');
+    const size_t name_len = args ? (size_t)(args - i->name) : strlen(i->name);
+
+    if (clang_getCursorKind(cursor) == (args ? CXCursor_ClassTemplate : CXCursor_ClassDecl)) {
         CXString current_class = clang_getCursorSpelling(cursor);
 
-        ClangClassInfo *i = (ClangClassInfo * )client_data;
-        if (strcmp(clang_getCString(current_class), i->name) == 0) {
+        if (strlen(clang_getCString(current_class)) == name_len
+            && strncmp(clang_getCString(current_class), i->name, name_len) == 0) {
             i->cursor = cursor;
             clang_disposeString(current_class);
             return CXChildVisit_Break;
@@ -120,6 +302,12 @@ typedef struct {
     const char *name;
     const char **arg_types;
     size_t arg_len;
+    const char *return_type;
+    // class declaring method (base class for inherited ones)
+    const char *owner;
+    int is_const;
+    int is_static;
+    int is_noexcept;
 } MethodInfo;
 
 typedef struct {
@@ -128,69 +316,713 @@ typedef struct {
     size_t constr_len;
     MethodInfo *methods;
     size_t method_len;
+    // "typename T, size_t N" of class template (class_name is its instantiation), NULL otherwise
+    char *template_params;
 } FuzgenData;
 
+void deinit_method(MethodInfo *m) {
+    free((char *)m->name);
+    free((char *)m->return_type);
+    free((char *)m->owner);
+    for (size_t j = 0; j < m->arg_len; ++j)
+        free((char *)m->arg_types[j]);
+    free(m->arg_types);
+}
+
 void deinit(FuzgenData *d) {
-    for (size_t i = 0; i < 10; ++i) {
-        for (size_t j = 0; i < d->constr_len && j < d->constructors[i].arg_len; ++j)
-            free(d->constructors[i].arg_types[j]);
-        free(d->constructors[i].arg_types);        
+    for (size_t i = 0; i < d->constr_len; ++i) {
+        for (size_t j = 0; j < d->constructors[i].arg_len; ++j)
+            free((char *)d->constructors[i].arg_types[j]);
+        free(d->constructors[i].arg_types);
     }
     free(d->constructors);
-    
-    for (size_t i = 0; i < 10; ++i) {
-        if (i < d->method_len)
-            free(d->methods[i].name);
-        for (size_t j = 0; i < d->method_len && j < d->methods[i].arg_len; ++j)
-            free(d->methods[i].arg_types[j]);
-        free(d->methods[i].arg_types);
-    }
+
+    for (size_t i = 0; i < d->method_len; ++i)
+        deinit_method(&d->methods[i]);
     free(d->methods);
+    free(d->template_params);
 }
 
-CXChildVisitResult dump_class_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
-    FuzgenData *d = (FuzgenData *)client_data;
-    CXString s = clang_getCursorSpelling(parent);
-    if (strcmp(d->class_name, clang_getCString(s)))
-        return CXChildVisit_Break;
-    clang_disposeString(s);
+// Lists grow one by one, new entries are zeroed
 
-    if (clang_getCursorKind(cursor) == CXCursor_Constructor) {
-        ConstructorInfo *cur = d->constructors + d->constr_len;
-        d->constr_len++;
+ConstructorInfo *add_constructor(FuzgenData *d) {
+    d->constructors = realloc(d->constructors, (d->constr_len + 1) * sizeof(ConstructorInfo));
+    memset(d->constructors + d->constr_len, 0, sizeof(ConstructorInfo));
+    return d->constructors + d->constr_len++;
+}
+
+MethodInfo *add_method(FuzgenData *d) {
+    d->methods = realloc(d->methods, (d->method_len + 1) * sizeof(MethodInfo));
+    memset(d->methods + d->method_len, 0, sizeof(MethodInfo));
+    return d->methods + d->method_len++;
+}
+
+void add_arg_type(const char ***arg_types, size_t *arg_len, const char *type) {
+    *arg_types = realloc(*arg_types, (*arg_len + 1) * sizeof(const char *));
+    (*arg_types)[(*arg_len)++] = type;
+}
+
+typedef struct {
+    FuzgenData *d;
+    // owner of own members (template itself for its instantiations)
+    const char *owner;
+} ClassVisit;
+
+void add_member(CXCursor cursor, MemberKind kind, CXCursor owner, int inherited, void *data) {
+    ClassVisit *v = (ClassVisit *)data;
+    FuzgenData *d = v->d;
+
+    if (kind == MEMBER_CONSTRUCTOR) {
+        ConstructorInfo *cur = add_constructor(d);
 
         CXType constructorType = clang_getCursorType(cursor);
-        cur->arg_len = clang_getNumArgTypes(constructorType);
+        const size_t arg_len = clang_getNumArgTypes(constructorType);
 
-        for (size_t i = 0; i < cur->arg_len; ++i) {
-            cur->arg_types[i] = clang_getCString(clang_getTypeSpelling(clang_getArgType(constructorType, i)));
-        }
-    } else if (clang_getCursorKind(cursor) == CXCursor_CXXMethod) {
-        MethodInfo *cur = d->methods + d->method_len;
-        d->method_len++;
+        for (size_t i = 0; i < arg_len; ++i)
+            add_arg_type(&cur->arg_types, &cur->arg_len,
+                clang_getCString(clang_getTypeSpelling(clang_getArgType(constructorType, i))));
+        return;
+    }
+
+    MethodInfo *cur = add_method(d);
+
+    cur->name = clang_getCString(clang_getCursorSpelling(cursor));
+    cur->return_type = clang_getCString(clang_getTypeSpelling(clang_getCursorResultType(cursor)));
+    CXString base_name = clang_getCursorSpelling(owner);
+    cur->owner = strdup(inherited ? clang_getCString(base_name) : v->owner);
+    clang_disposeString(base_name);
+
+    // qualifiers
+    cur->is_const = clang_CXXMethod_isConst(cursor);
+    cur->is_static = kind == MEMBER_STATIC;
+    switch (clang_getCursorExceptionSpecificationType(cursor)) {
+        case CXCursor_ExceptionSpecificationKind_BasicNoexcept:
+        case CXCursor_ExceptionSpecificationKind_DynamicNone:
+            cur->is_noexcept = 1;
+            break;
+        default:
+            cur->is_noexcept = 0;
+    }
 
-        cur->name = clang_getCString(clang_getCursorSpelling(cursor));
-        
-        CXType methodType = clang_getCursorType(cursor);
-        cur->arg_len = clang_getNumArgTypes(methodType);
+    CXType methodType = clang_getCursorType(cursor);
+    const size_t arg_len = clang_getNumArgTypes(methodType);
 
-        for (size_t i = 0; i < cur->arg_len; ++i) {
-            cur->arg_types[i] = clang_getCString(clang_getTypeSpelling(clang_getArgType(methodType, i)));
-        }
+    for (size_t i = 0; i < arg_len; ++i)
+        add_arg_type(&cur->arg_types, &cur->arg_len,
+            clang_getCString(clang_getTypeSpelling(clang_getArgType(methodType, i))));
+}
+
+// Template parameters in declaration order, template template ones can't be written
+// as generated parameter, so whole list is dropped then
+CXChildVisitResult template_params_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data) {
+    FuzgenData *d = (FuzgenData *)client_data;
+    const enum CXCursorKind kind = clang_getCursorKind(cursor);
+    if (kind != CXCursor_TemplateTypeParameter && kind != CXCursor_NonTypeTemplateParameter
+        && kind != CXCursor_TemplateTemplateParameter)
+        return CXChildVisit_Continue;
+    if (kind == CXCursor_TemplateTemplateParameter || !d->template_params) {
+        free(d->template_params);
+        d->template_params = 0;
+        return CXChildVisit_Break;
     }
+
+    CXString name = clang_getCursorSpelling(cursor);
+    CXString type = clang_getTypeSpelling(clang_getCursorType(cursor));
+    const char *head = kind == CXCursor_TemplateTypeParameter ? "typename" : clang_getCString(type);
+    const size_t len = strlen(d->template_params);
+    d->template_params = realloc(d->template_params, len + strlen(head) + strlen(clang_getCString(name)) + 4);
+    sprintf(d->template_params + len, "%s%s %s", len ? ", " : "", head, clang_getCString(name));
+    clang_disposeString(name);
+    clang_disposeString(type);
     return CXChildVisit_Continue;
 }
 
+FuzgenData new_data(const char *class_name) {
+    FuzgenData d = {class_name, 0, 0, 0, 0, 0};
+    return d;
+}
+
+// Class template gives template_params (NULL if they can't be written)
 FuzgenData from_class(const char *class_name, CXCursor class_cursor) {
-    FuzgenData d = {class_name, malloc(10 * sizeof(ConstructorInfo)), 0, malloc(10 * sizeof(MethodInfo)), 0};
-    for (size_t i = 0; i < 10; ++i) {
-        d.constructors[i].arg_types = malloc(10 * sizeof(const char *));
-        d.methods[i].arg_types = malloc(10 * sizeof(const char *));
+    FuzgenData d = new_data(class_name);
+    if (clang_getCursorKind(class_cursor) == CXCursor_ClassTemplate) {
+        d.template_params = strdup("");
+        clang_visitChildren(class_cursor, template_params_visitor, (CXClientData)&d);
     }
-    clang_visitChildren(class_cursor, dump_class_visitor, (CXClientData)&d);
+    // instantiations of template share keys of its wrappers, so owner is template itself
+    CXString owner = clang_getCursorSpelling(class_cursor);
+    ClassVisit v = {&d, d.template_params ? clang_getCString(owner) : class_name};
+    stats.ast_nodes += visit_members(class_cursor, add_member, &v);
+    clang_disposeString(owner);
     return d;
 }
 
+///////////////////////////// SIGNATURE /////////////////////////////
+
+// Bump on every change of generated code, so old harnesses get rewritten
+const unsigned GENERATOR_VERSION = 14;
+
+const char *MANIFEST = "cfuzz.manifest";
+
+typedef unsigned long long Hash;
+
+// FNV-1a
+Hash hash_bytes(Hash h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Includes terminating zero, so neighbouring strings can't run into each other
+Hash hash_str(Hash h, const char *s) {
+    return hash_bytes(h, s, strlen(s) + 1);
+}
+
+// Stable over everything that ends up in generated harness
+Hash signature(const char *header_name, FuzgenData *d, size_t class_len, Backend backend, const char *diff, size_t workers, int split) {
+    Hash h = 0xcbf29ce484222325ull;
+    h = hash_bytes(h, &GENERATOR_VERSION, sizeof(GENERATOR_VERSION));
+    h = hash_bytes(h, &backend, sizeof(backend));
+    h = hash_str(h, diff ? diff : "");
+    h = hash_bytes(h, &workers, sizeof(workers));
+    h = hash_bytes(h, &split, sizeof(split));
+    h = hash_str(h, header_name);
+
+    for (size_t k = 0; k < class_len; ++k) {
+        h = hash_str(h, d[k].class_name);
+        h = hash_str(h, d[k].template_params ? d[k].template_params : "");
+
+        h = hash_bytes(h, &d[k].constr_len, sizeof(size_t));
+        for (size_t i = 0; i < d[k].constr_len; ++i) {
+            h = hash_bytes(h, &d[k].constructors[i].arg_len, sizeof(size_t));
+            for (size_t j = 0; j < d[k].constructors[i].arg_len; ++j)
+                h = hash_str(h, d[k].constructors[i].arg_types[j]);
+        }
+
+        h = hash_bytes(h, &d[k].method_len, sizeof(size_t));
+        for (size_t i = 0; i < d[k].method_len; ++i) {
+            const MethodInfo *m = &d[k].methods[i];
+            const int quals[3] = {m->is_const, m->is_static, m->is_noexcept};
+            h = hash_str(h, m->name);
+            h = hash_str(h, m->return_type);
+            h = hash_str(h, m->owner);
+            h = hash_bytes(h, quals, sizeof(quals));
+            h = hash_bytes(h, &m->arg_len, sizeof(size_t));
+            for (size_t j = 0; j < m->arg_len; ++j)
+                h = hash_str(h, m->arg_types[j]);
+        }
+    }
+    return h;
+}
+
+// Manifest sits next to generated files and has line "<signature> <content hash> <name>" per file
+// (name is file name in that directory, it may have spaces)
+
+// Manifest of output goes to buf, returns file name part of output
+const char *manifest_path(const char *output, char *buf, size_t size) {
+    const char *slash = strrchr(output, '/');
+    const char *name = slash ? slash + 1 : output;
+    snprintf(buf, size, "%.*s%s", (int)(name - output), output, MANIFEST);
+    return name;
+}
+
+// 0 if whole file was hashed
+int file_hash(const char *path, Hash *h) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 1;
+    char buf[65536];
+    size_t n;
+    *h = 0xcbf29ce484222325ull;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        *h = hash_bytes(*h, buf, n);
+    const int err = ferror(f);
+    fclose(f);
+    return err;
+}
+
+// 0 if signature line near top of generated file was read
+int file_signature(const char *path, Hash *h) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 1;
+    char line[256];
+    int found = 0;
+    for (int i = 0; !found && i < 4 && fgets(line, sizeof(line), f); ++i)
+        found = sscanf(line, "/// Signature %llx", h) == 1;
+    fclose(f);
+    return !found;
+}
+
+// 1 if line was parsed, name points into line
+int manifest_line(char *line, Hash *h, Hash *content, const char **name) {
+    char *end;
+    line[strcspn(line, "\n")] = '\0';
+    *h = strtoull(line, &end, 16);
+    if (end == line || *end != ' ')
+        return 0;
+    line = end + 1;
+    *content = strtoull(line, &end, 16);
+    if (end == line || *end != ' ')
+        return 0;
+    *name = end + 1;
+    return 1;
+}
+
+// 1 if manifest has same signature for output, and output is what was written then
+int manifest_up_to_date(const char *output, Hash h) {
+    char path[4096];
+    const char *name = manifest_path(output, path, sizeof(path));
+    Hash file_sig, file_content;
+    if (file_signature(output, &file_sig) || file_sig != h || file_hash(output, &file_content))
+        return 0;
+
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+
+    int found = 0;
+    char line[4096 + 64];
+    Hash line_hash, line_content;
+    const char *line_name;
+    while (!found && fgets(line, sizeof(line), f))
+        found = manifest_line(line, &line_hash, &line_content, &line_name)
+            && line_hash == h && line_content == file_content && strcmp(line_name, name) == 0;
+
+    fclose(f);
+    return found;
+}
+
+// Rewritten through temp file, so concurrent readers see old or new manifest
+void manifest_update(const char *output, Hash h) {
+    char path[4096], tmp_name[4096 + 8];
+    const char *name = manifest_path(output, path, sizeof(path));
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", path);
+
+    Hash content;
+    if (file_hash(output, &content))
+        return;
+
+    FILE *tmp = fopen(tmp_name, "w");
+    if (!tmp)
+        return;
+
+    FILE *f = fopen(path, "r");
+    if (f) {
+        char line[4096 + 64];
+        Hash line_hash, line_content;
+        const char *line_name;
+        while (fgets(line, sizeof(line), f))
+            if (manifest_line(line, &line_hash, &line_content, &line_name) && strcmp(line_name, name) != 0)
+                fprintf(tmp, "%016llx %016llx %s\n", line_hash, line_content, line_name);
+        fclose(f);
+    }
+    fprintf(tmp, "%016llx %016llx %s\n", h, content, name);
+
+    fclose(tmp);
+    rename(tmp_name, path);
+}
+
+///////////////////////////// MODEL /////////////////////////////
+
+// Extracted classes can be saved and rendered later without libclang.
+// Text form is YAML (same keys as jinja2/template_data_example.txt, classes in list),
+// binary form is for fast loading of big batches: "CFZM", version,
+// then u32 counts and strings as u32 length + bytes, in host byte order.
+// Load detects form by magic. Version 1 models have no method owner (always own class),
+// before version 3 there are no template parameters (empty string in binary form is none).
+
+const unsigned MODEL_VERSION = 3;
+const char MODEL_MAGIC[4] = {'C', 'F', 'Z', 'M'};
+
+typedef struct {
+    char *header_path;
+    FuzgenData *classes;
+    size_t class_len;
+} Model;
+
+void model_free(Model *m) {
+    for (size_t k = 0; k < m->class_len; ++k) {
+        free((char *)m->classes[k].class_name);
+        deinit(&m->classes[k]);
+    }
+    free(m->classes);
+    free(m->header_path);
+}
+
+void yaml_str(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+void yaml_list(FILE *f, const char **items, size_t len) {
+    fputc('[', f);
+    for (size_t i = 0; i < len; ++i) {
+        if (i)
+            fputs(", ", f);
+        yaml_str(f, items[i]);
+    }
+    fputc(']', f);
+}
+
+void model_write_yaml(const char *header_name, FuzgenData *d, size_t class_len, FILE *f) {
+    fprintf(f, "version: %u\nclass_header: ", MODEL_VERSION);
+    yaml_str(f, header_name);
+    fputs("\nclasses:\n", f);
+
+    for (size_t k = 0; k < class_len; ++k) {
+        fputs("- class_name: ", f);
+        yaml_str(f, d[k].class_name);
+        if (d[k].template_params) {
+            fputs("\n  template_params: ", f);
+            yaml_str(f, d[k].template_params);
+        }
+        fputs("\n  constructors:\n", f);
+        for (size_t i = 0; i < d[k].constr_len; ++i) {
+            fputs("  - ", f);
+            yaml_list(f, d[k].constructors[i].arg_types, d[k].constructors[i].arg_len);
+            fputc('\n', f);
+        }
+
+        fputs("  methods:\n", f);
+        for (size_t i = 0; i < d[k].method_len; ++i) {
+            const MethodInfo *m = &d[k].methods[i];
+            fputs("  - name: ", f);
+            yaml_str(f, m->name);
+            fputs("\n    args: ", f);
+            yaml_list(f, m->arg_types, m->arg_len);
+            fputs("\n    return_type: ", f);
+            yaml_str(f, m->return_type);
+            fputs("\n    owner: ", f);
+            yaml_str(f, m->owner);
+            fprintf(f, "\n    const: %s\n    static: %s\n    noexcept: %s\n",
+                m->is_const ? "true" : "false",
+                m->is_static ? "true" : "false",
+                m->is_noexcept ? "true" : "false"
+            );
+        }
+    }
+}
+
+void bin_u32(FILE *f, size_t v) {
+    const unsigned u = v;
+    fwrite(&u, sizeof(u), 1, f);
+}
+
+void bin_str(FILE *f, const char *s) {
+    bin_u32(f, strlen(s));
+    fputs(s, f);
+}
+
+void model_write_bin(const char *header_name, FuzgenData *d, size_t class_len, FILE *f) {
+    fwrite(MODEL_MAGIC, sizeof(MODEL_MAGIC), 1, f);
+    bin_u32(f, MODEL_VERSION);
+    bin_str(f, header_name);
+    bin_u32(f, class_len);
+
+    for (size_t k = 0; k < class_len; ++k) {
+        bin_str(f, d[k].class_name);
+        bin_str(f, d[k].template_params ? d[k].template_params : "");
+        bin_u32(f, d[k].constr_len);
+        for (size_t i = 0; i < d[k].constr_len; ++i) {
+            bin_u32(f, d[k].constructors[i].arg_len);
+            for (size_t j = 0; j < d[k].constructors[i].arg_len; ++j)
+                bin_str(f, d[k].constructors[i].arg_types[j]);
+        }
+
+        bin_u32(f, d[k].method_len);
+        for (size_t i = 0; i < d[k].method_len; ++i) {
+            const MethodInfo *m = &d[k].methods[i];
+            bin_str(f, m->name);
+            bin_str(f, m->return_type);
+            bin_str(f, m->owner);
+            fputc(m->is_const | m->is_static << 1 | m->is_noexcept << 2, f);
+            bin_u32(f, m->arg_len);
+            for (size_t j = 0; j < m->arg_len; ++j)
+                bin_str(f, m->arg_types[j]);
+        }
+    }
+}
+
+// Writes <base>.yaml and <base>.cfm, 1 on error
+int model_save(const char *base, const char *header_name, FuzgenData *d, size_t class_len) {
+    char name[4096];
+    snprintf(name, sizeof(name), "%s.yaml", base);
+    FILE *f = fopen(name, "w");
+    if (!f)
+        return 1;
+    model_write_yaml(header_name, d, class_len, f);
+    fclose(f);
+
+    snprintf(name, sizeof(name), "%s.cfm", base);
+    f = fopen(name, "wb");
+    if (!f)
+        return 1;
+    model_write_bin(header_name, d, class_len, f);
+    fclose(f);
+    return 0;
+}
+
+Model *model_add_class(Model *m, char *class_name) {
+    m->classes = realloc(m->classes, (m->class_len + 1) * sizeof(FuzgenData));
+    m->classes[m->class_len++] = new_data(class_name);
+    return m;
+}
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    int ok;
+} BinReader;
+
+size_t bin_read_u32(BinReader *r) {
+    unsigned u = 0;
+    if (r->end - r->p < (ptrdiff_t)sizeof(u)) {
+        r->ok = 0;
+        return 0;
+    }
+    memcpy(&u, r->p, sizeof(u));
+    r->p += sizeof(u);
+    return u;
+}
+
+// Count of items, each takes at least one more byte of input
+size_t bin_read_len(BinReader *r) {
+    const size_t len = bin_read_u32(r);
+    if (len > (size_t)(r->end - r->p)) {
+        r->ok = 0;
+        return 0;
+    }
+    return len;
+}
+
+char *bin_read_str(BinReader *r) {
+    const size_t len = bin_read_u32(r);
+    if (!r->ok || (size_t)(r->end - r->p) < len) {
+        r->ok = 0;
+        return strdup("");
+    }
+    char *s = malloc(len + 1);
+    memcpy(s, r->p, len);
+    s[len] = '\0';
+    r->p += len;
+    return s;
+}
+
+// 1 on error
+int model_read_bin(const char *buf, size_t size, Model *m) {
+    BinReader r = {(const unsigned char *)buf + sizeof(MODEL_MAGIC), (const unsigned char *)buf + size, 1};
+    const unsigned version = bin_read_u32(&r);
+    if (version > MODEL_VERSION)
+        return 1;
+
+    m->header_path = bin_read_str(&r);
+    const size_t class_len = bin_read_u32(&r);
+    for (size_t k = 0; r.ok && k < class_len; ++k) {
+        FuzgenData *d = &model_add_class(m, bin_read_str(&r))->classes[k];
+        if (version >= 3) {
+            d->template_params = bin_read_str(&r);
+            if (!*d->template_params) {
+                free(d->template_params);
+                d->template_params = 0;
+            }
+        }
+
+        const size_t constr_len = bin_read_len(&r);
+        for (size_t i = 0; r.ok && i < constr_len; ++i) {
+            ConstructorInfo *c = add_constructor(d);
+            const size_t arg_len = bin_read_len(&r);
+            for (size_t j = 0; r.ok && j < arg_len; ++j)
+                add_arg_type(&c->arg_types, &c->arg_len, bin_read_str(&r));
+        }
+
+        const size_t method_len = bin_read_len(&r);
+        for (size_t i = 0; r.ok && i < method_len; ++i) {
+            MethodInfo *mi = add_method(d);
+            mi->name = bin_read_str(&r);
+            mi->return_type = bin_read_str(&r);
+            mi->owner = version >= 2 ? bin_read_str(&r) : strdup(d->class_name);
+            const unsigned flags = r.p < r.end ? *r.p++ : 0;
+            mi->is_const = flags & 1;
+            mi->is_static = flags >> 1 & 1;
+            mi->is_noexcept = flags >> 2 & 1;
+            const size_t arg_len = bin_read_len(&r);
+            for (size_t j = 0; r.ok && j < arg_len; ++j)
+                add_arg_type(&mi->arg_types, &mi->arg_len, bin_read_str(&r));
+        }
+    }
+    return !r.ok;
+}
+
+const char *yaml_skip(const char *s) {
+    while (*s == ' ' || *s == '\t')
+        ++s;
+    return s;
+}
+
+// Quoted or plain scalar, plain one ends on one of stop chars outside of <> and ()
+char *yaml_scalar(const char *s, const char *stop, const char **end) {
+    char *out = malloc(strlen(s) + 1);
+    size_t len = 0;
+
+    if (*s == '"') {
+        for (++s; *s && *s != '"'; ++s) {
+            if (*s == '\\' && s[1])
+                ++s;
+            out[len++] = *s;
+        }
+        if (*s == '"')
+            ++s;
+    } else {
+        int depth = 0;
+        for (; *s && *s != '\n' && !(depth == 0 && strchr(stop, *s)); ++s) {
+            depth += *s == '<' || *s == '(';
+            depth -= *s == '>' || *s == ')';
+            out[len++] = *s;
+        }
+        while (len && (out[len - 1] == ' ' || out[len - 1] == '\t' || out[len - 1] == '\r'))
+            --len;
+    }
+
+    out[len] = '\0';
+    *end = s;
+    return out;
+}
+
+// Flow sequence "[a, b]", 1 on error
+int yaml_read_list(const char *s, const char ***items, size_t *len) {
+    if (*s != '[')
+        return 1;
+    s = yaml_skip(s + 1);
+    while (*s && *s != ']') {
+        add_arg_type(items, len, yaml_scalar(s, ",]", &s));
+        s = yaml_skip(s);
+        if (*s == ',')
+            s = yaml_skip(s + 1);
+    }
+    return *s != ']';
+}
+
+// Only reads what model_write_yaml writes (and template_data_example.txt), 1 on error
+int model_read_yaml(char *buf, Model *m) {
+    enum {SECTION_NONE, SECTION_CONSTRUCTORS, SECTION_METHODS} section = SECTION_NONE;
+    FuzgenData *d = 0;
+    MethodInfo *mi = 0;
+
+    for (char *line = buf, *next; line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+
+        const char *s = yaml_skip(line);
+        if (*s == '#' || *s == '\0' || *s == '\r')
+            continue;
+        const int item = *s == '-';
+        if (item)
+            s = yaml_skip(s + 1);
+
+        // constructor is just list of argument types
+        if (*s == '[') {
+            if (!d || section != SECTION_CONSTRUCTORS)
+                return 1;
+            ConstructorInfo *c = add_constructor(d);
+            if (yaml_read_list(s, &c->arg_types, &c->arg_len))
+                return 1;
+            continue;
+        }
+
+        const char *colon = strchr(s, ':');
+        if (!colon)
+            return 1;
+        const size_t key_len = colon - s;
+        const char *value = yaml_skip(colon + 1);
+        #define KEY(k) (key_len == strlen(k) && strncmp(s, k, key_len) == 0)
+
+        if (KEY("version")) {
+            if ((unsigned)atoi(value) > MODEL_VERSION)
+                return 1;
+        } else if (KEY("class_header")) {
+            free(m->header_path);
+            m->header_path = yaml_scalar(value, "#", &value);
+        } else if (KEY("classes")) {
+            section = SECTION_NONE;
+        } else if (KEY("class_name")) {
+            d = &model_add_class(m, yaml_scalar(value, "#", &value))->classes[m->class_len - 1];
+            mi = 0;
+            section = SECTION_NONE;
+        } else if (KEY("template_params") && d && !mi) {
+            free(d->template_params);
+            d->template_params = yaml_scalar(value, "#", &value);
+        } else if (KEY("constructors")) {
+            section = SECTION_CONSTRUCTORS;
+        } else if (KEY("methods")) {
+            section = SECTION_METHODS;
+        } else if (section == SECTION_METHODS && item && KEY("name")) {
+            if (!d)
+                return 1;
+            mi = add_method(d);
+            mi->name = yaml_scalar(value, "#", &value);
+            mi->return_type = strdup("void");
+            mi->owner = strdup(d->class_name);
+        } else if (!mi) {
+            return 1;
+        } else if (KEY("args")) {
+            if (mi->arg_len || yaml_read_list(value, &mi->arg_types, &mi->arg_len))
+                return 1;
+        } else if (KEY("return_type")) {
+            free((char *)mi->return_type);
+            mi->return_type = yaml_scalar(value, "#", &value);
+        } else if (KEY("owner")) {
+            free((char *)mi->owner);
+            mi->owner = yaml_scalar(value, "#", &value);
+        } else if (KEY("const")) {
+            mi->is_const = strncmp(value, "true", 4) == 0;
+        } else if (KEY("static")) {
+            mi->is_static = strncmp(value, "true", 4) == 0;
+        } else if (KEY("noexcept")) {
+            mi->is_noexcept = strncmp(value, "true", 4) == 0;
+        } else {
+            return 1;
+        }
+        #undef KEY
+    }
+    return !m->header_path || m->class_len == 0;
+}
+
+// Either form, 1 on error (model is freed then)
+int model_load(const char *path, Model *m) {
+    Model empty = {0, 0, 0};
+    *m = empty;
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 1;
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(size + 1);
+    const size_t read = fread(buf, 1, size, f);
+    buf[read] = '\0';
+    fclose(f);
+
+    const int error = read >= sizeof(MODEL_MAGIC) && memcmp(buf, MODEL_MAGIC, sizeof(MODEL_MAGIC)) == 0
+        ? model_read_bin(buf, read, m)
+        : model_read_yaml(buf, m);
+    free(buf);
+
+    if (error)
+        model_free(m);
+    return error;
+}
+
 ///////////////////////////// WRITING FUZZER /////////////////////////////
 
 /// for debug
@@ -203,7 +1035,13 @@ void print_data(FuzgenData d) {
         puts("");
     }
     for (size_t i = 0; i < d.method_len; ++i) {
-        printf("Method %s\n", d.methods[i].name);
+        printf("Method %s %s%s%s%s\n",
+            d.methods[i].return_type,
+            d.methods[i].name,
+            d.methods[i].is_static ? " static" : "",
+            d.methods[i].is_const ? " const" : "",
+            d.methods[i].is_noexcept ? " noexcept" : ""
+        );
         for (size_t j = 0; j < d.methods[i].arg_len; ++j)
             printf("%s", d.methods[i].arg_types[j]);
         puts("");
@@ -211,98 +1049,439 @@ void print_data(FuzgenData d) {
 }
 
 /// 1 = header
-/// 2 = class name
-/// 3 = constructor fns
-/// 4 = constructor list
-/// 5 = method fns
-/// 6 = method list
-const char *CORE = 
+/// 2 = signature
+/// 3 = split wire format
+/// 4 = defines of cfuzz.hpp sections harness needs (diff or concurrent)
+const char *HEADER =
 "/// This file is autogenerated\n\
+/// Signature %2$016llx\n\
 \n\
 #include \"%1$s\"\n\
+%4$s#include \"cfuzz.hpp\"\n\
 \n\
 #include <cstdint>\n\
 #include <iterator> // for std::size\n\
 \n\
+// ids from front of chain and arguments from back (see wire format in cfuzz.hpp)\n\
+constexpr bool split_wire = %3$s;\n\
+\n\
+// Method metadata types\n\
+\n\
+enum MethodFlags : uint8_t {\n\
+    METHOD_CONST = 1,\n\
+    METHOD_STATIC = 2,\n\
+    METHOD_NOEXCEPT = 4,\n\
+};\n\
+\n\
+struct MethodMeta {\n\
+    const char *name;\n\
+    const char *return_type;\n\
+    uint8_t flags;\n\
+};\n\
+";
+
+/// Body of run_chain, names come from class namespace or template chain
+const char *RUN_CHAIN_BODY =
+"    // supported up to 255 constructors and methods\n\
+\n\
+#ifdef CFUZZ_TWO_PHASE\n\
+    // whole chain is decoded before obj is constructed (see two phase section of cfuzz.hpp)\n\
+    return cfuzz::run_decoded<constr_list, method_list, split_wire>(data, size, constr_base, method_base);\n\
+#else\n\
+    // empty string\n\
+    if (size == 0)\n\
+        return 0;\n\
+\n\
+    CFUZZ_TRACE_BEGIN(data);\n\
+    CFUZZ_ALLOC_EXEC(data, size);\n\
+\n\
+    // calls are decoded while they fit (see wire format in cfuzz.hpp)\n\
+    cfuzz::ChainReader<split_wire> chain(data, size);\n\
+    cfuzz::Call call;\n\
+\n\
+    // call constructor\n\
+    if (!chain.next<constr_list>(call))\n\
+        return 0;\n\
+    CFUZZ_TRACE_CALL(CALL_CONSTR, constr_base + call.id, call.args);\n\
+    auto obj = constr_list[call.id].fn(data + call.args);\n\
+    CFUZZ_STATE_CALL(obj, false);\n\
+\n\
+    // argumentless pure calls made since obj last changed (ids < 64)\n\
+    uint64_t pure_seen = 0;\n\
+\n\
+    const uint64_t start = cfuzz::budget_begin();\n\
+    size_t calls = 0;\n\
+\n\
+    while (chain.next<method_list>(call)) {\n\
+        // stop long chains\n\
+        if (cfuzz::budget_over(calls, start))\n\
+            return 0;\n\
+        calls += 1;\n\
+\n\
+        // call method, unless it is a pure call that can't give anything new (CFUZZ_SKIP_PURE)\n\
+        const MethodData &m = method_list[call.id];\n\
+        const uint64_t bit = cfuzz::skip_pure_calls && m.pure && m.arg_size == 0 && call.id < 64 ? 1ull << call.id : 0;\n\
+        if (!(pure_seen & bit)) {\n\
+            CFUZZ_TRACE_CALL(CALL_METHOD, method_base + call.id, call.args);\n\
+            m.fn(&obj, data + call.args);\n\
+            CFUZZ_STATE_CALL(obj, m.pure);\n\
+        }\n\
+        pure_seen = m.pure ? pure_seen | bit : 0;\n\
+    }\n\
+\n\
+    return 0;\n\
+#endif\n\
+";
+
+/// 1 = class name
+/// 2 = constructor fns
+/// 3 = constructor list
+/// 4 = method fns
+/// 5 = method list
+/// 6 = method meta list
+/// 7 = constructor name list
+/// 8 = method name list
+/// 9 = first global constructor id
+/// 10 = first global method id
+/// 11 = namespace suffix (class name, or implementation_class in diff mode)
+/// 12 = object type (class, or cfuzz::NoObject for static calls)
+/// 13 = run_chain body
+const char *CLASS_CORE =
+"\n\
+///////////////////////////// %1$s /////////////////////////////\n\
+\n\
+namespace fuzz_%11$s {\n\
+\n\
+const char *const class_name = \"%1$s\";\n\
+\n\
+// first global ids of this class, see call_name in runtime section\n\
+constexpr size_t constr_base = %9$zu;\n\
+constexpr size_t method_base = %10$zu;\n\
+\n\
 // Constructor section\n\
 \n\
 struct ConstrData {\n\
     size_t arg_size;\n\
-    %2$s (*fn)(const uint8_t *);\n\
+    %12$s (*fn)(const uint8_t *);\n\
 };\n\
 \n\
-%3$s\n\
-\n\
-const ConstrData constr_list[] = {\n\
-%4$s};\n\
-constexpr size_t constr_size = std::size(constr_list);\n\
+%2$s\n\
 \n\
 // Method section\n\
 \n\
 struct MethodData {\n\
     size_t arg_size;\n\
-    void (*fn)(%2$s *, const uint8_t *);\n\
+    void (*fn)(%12$s *, const uint8_t *);\n\
+    // const, so obj state can't change\n\
+    bool pure;\n\
 };\n\
 \n\
-%5$s\n\
+%4$s\n\
+\n\
+// Tables section (hot tables go together)\n\
+\n\
+const ConstrData constr_list[] = {\n\
+%3$s};\n\
+constexpr size_t constr_size = std::size(constr_list);\n\
 \n\
 const MethodData method_list[] = {\n\
-%6$s};\n\
+%5$s};\n\
 constexpr size_t method_size = std::size(method_list);\n\
 \n\
+// Metadata section\n\
 \n\
-extern \"C\" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {\n\
-    // supported up to 255 constructors and methods\n\
+const MethodMeta method_meta[] = {\n\
+%6$s};\n\
 \n\
-    // empty string\n\
+const char *const constr_names[] = {\n\
+%7$s};\n\
+\n\
+const char *const method_names[] = {\n\
+%8$s};\n\
+\n\
+const char *call_name(cfuzz::CallKind kind, size_t id) {\n\
+    return kind == cfuzz::CALL_CONSTR ? constr_names[id] : method_names[id];\n\
+}\n\
+\n\
+size_t call_arg_size(cfuzz::CallKind kind, size_t id) {\n\
+    return kind == cfuzz::CALL_CONSTR ? constr_list[id].arg_size : method_list[id].arg_size;\n\
+}\n\
+\n\
+// Run one chain of this class\n\
+int run_chain(const uint8_t *data, size_t size) {\n\
+%13$s}\n\
+\n\
+} // namespace fuzz_%11$s\n\
+";
+
+/// 1 = class name
+/// 2 = first implementation namespace
+/// 3 = second implementation namespace
+/// 4 = first implementation namespace suffix
+/// 5 = second implementation namespace suffix
+const char *DIFF_CLASS =
+"\n\
+///////////////////////////// DIFF %1$s /////////////////////////////\n\
+\n\
+// Same chain runs on implementations from %2$s and %3$s, returns are compared after each call.\n\
+// Tables are taken from first one, both are generated from same class data.\n\
+namespace fuzz_%1$s {\n\
+\n\
+using namespace fuzz_%4$s;\n\
+namespace impl_a = fuzz_%4$s;\n\
+namespace impl_b = fuzz_%5$s;\n\
+\n\
+int run_chain(const uint8_t *data, size_t size) {\n\
     if (size == 0)\n\
         return 0;\n\
 \n\
-    // get constr id\n\
-    size_t args = 0;\n\
-    auto c = constr_list[data[args] %% constr_size];\n\
-    args += 1;\n\
+    CFUZZ_TRACE_BEGIN(data);\n\
+    CFUZZ_ALLOC_EXEC(data, size);\n\
+\n\
+    cfuzz::ChainReader<split_wire> chain(data, size);\n\
+    cfuzz::Call call;\n\
 \n\
-    // check if we have enough space for arguments\n\
-    if (args + c.arg_size > size)\n\
+    if (!chain.next<constr_list>(call))\n\
         return 0;\n\
+    CFUZZ_TRACE_CALL(CALL_CONSTR, constr_base + call.id, call.args);\n\
+    auto obj_a = impl_a::constr_list[call.id].fn(data + call.args);\n\
+    auto obj_b = impl_b::constr_list[call.id].fn(data + call.args);\n\
 \n\
-    // call constructor\n\
-    auto obj = c.fn(data + args);\n\
-    args += c.arg_size;\n\
+    uint64_t pure_seen = 0;\n\
+\n\
+    const uint64_t start = cfuzz::budget_begin();\n\
+    size_t calls = 0;\n\
+\n\
+    while (chain.next<method_list>(call)) {\n\
+        if (cfuzz::budget_over(calls, start))\n\
+            return 0;\n\
+        calls += 1;\n\
+\n\
+        const MethodData &m = method_list[call.id];\n\
+        const uint64_t bit = cfuzz::skip_pure_calls && m.pure && m.arg_size == 0 && call.id < 64 ? 1ull << call.id : 0;\n\
+        if (!(pure_seen & bit)) {\n\
+            CFUZZ_TRACE_CALL(CALL_METHOD, method_base + call.id, call.args);\n\
+            cfuzz::diff_ret.size = 0;\n\
+            m.fn(&obj_a, data + call.args);\n\
+            const cfuzz::DiffRet ret_a = cfuzz::diff_ret;\n\
+\n\
+            cfuzz::diff_ret.size = 0;\n\
+            impl_b::method_list[call.id].fn(&obj_b, data + call.args);\n\
+            cfuzz::diff_check(ret_a, cfuzz::diff_ret, calls - 1, method_names[call.id]);\n\
+        }\n\
+        pure_seen = m.pure ? pure_seen | bit : 0;\n\
+    }\n\
+\n\
+    return 0;\n\
+}\n\
+\n\
+} // namespace fuzz_%1$s\n\
+";
+
+/// 1 = namespace suffix
+/// 2 = workers
+/// 3 = object type
+const char *CONCURRENT_CLASS =
+"\n\
+// Concurrent section: method calls of chain are dealt to workers sharing obj\n\
 \n\
-    // check if we have enough space for method id\n\
-    if (args >= size)\n\
+namespace fuzz_%1$s {\n\
+\n\
+constexpr size_t workers = %2$zu;\n\
+\n\
+// Worker decodes whole chain and runs calls dealt to it,\n\
+// nothing is skipped since other workers change obj in between\n\
+void run_worker(size_t w, uint8_t selector, const uint8_t *data, cfuzz::ChainReader<split_wire> chain, %3$s *obj) {\n\
+    CFUZZ_TRACE_BEGIN(data);\n\
+\n\
+    cfuzz::Call call;\n\
+    size_t calls = 0;\n\
+    while (!(cfuzz::call_limit && calls >= cfuzz::call_limit) && chain.next<method_list>(call)) {\n\
+        if (cfuzz::worker_of(selector, calls, workers) == w) {\n\
+            CFUZZ_TRACE_CALL(CALL_METHOD, method_base + call.id, call.args);\n\
+            method_list[call.id].fn(obj, data + call.args);\n\
+        }\n\
+        calls += 1;\n\
+    }\n\
+}\n\
+\n\
+// Leading byte selects how calls are dealt to workers\n\
+int run_concurrent(const uint8_t *data, size_t size) {\n\
+    if (size < 2)\n\
         return 0;\n\
+    const uint8_t selector = data[0];\n\
+    data += 1;\n\
+    size -= 1;\n\
 \n\
-    // get method\n\
-    auto m = method_list[data[args] %% method_size];\n\
-    args += 1;\n\
+    CFUZZ_TRACE_BEGIN(data);\n\
 \n\
-    while (args + m.arg_size <= size) {\n\
-        // call method\n\
-        m.fn(&obj, data + args);\n\
-        args += m.arg_size;\n\
+    cfuzz::ChainReader<split_wire> chain(data, size);\n\
+    cfuzz::Call call;\n\
+    if (!chain.next<constr_list>(call))\n\
+        return 0;\n\
 \n\
-        // check if we have space for another method\n\
-        if (args >= size)\n\
-            return 0;\n\
+    CFUZZ_TRACE_CALL(CALL_CONSTR, constr_base + call.id, call.args);\n\
+    auto obj = constr_list[call.id].fn(data + call.args);\n\
+\n\
+    auto job = [&](size_t w) { run_worker(w, selector, data, chain, &obj); };\n\
+    cfuzz::run_workers(workers, job);\n\
+    return 0;\n\
+}\n\
+\n\
+} // namespace fuzz_%1$s\n\
+";
+
+/// 1 = class list items
+/// 2 = class selector
+/// 3 = total constructors
+/// 4 = total methods
+/// 5 = chain run function of class namespace
+/// 6 = canonical form template
+/// 7 = worker selector
+const char *FOOTER =
+"\n\
+///////////////////////////// CLASSES /////////////////////////////\n\
 \n\
-        // get new method\n\
-        m = method_list[data[args] %% method_size];\n\
-        args += 1;\n\
+#define CFUZZ_CLASSES(X)%1$s\n\
+\n\
+struct ClassData {\n\
+    const char *name;\n\
+    int (*run)(const uint8_t *, size_t);\n\
+    size_t constr_size;\n\
+    size_t method_size;\n\
+    const char *(*call_name)(cfuzz::CallKind, size_t);\n\
+    size_t (*call_arg_size)(cfuzz::CallKind, size_t);\n\
+    size_t (*canonical)(uint8_t *, size_t);\n\
+};\n\
+\n\
+#define CLASS_DATA(ns) {ns::class_name, ns::%5$s, ns::constr_size, ns::method_size, ns::call_name, ns::call_arg_size, \\\n\
+    cfuzz::%6$s<ns::constr_list, ns::method_list, split_wire>},\n\
+const ClassData class_list[] = {\n\
+    CFUZZ_CLASSES(CLASS_DATA)\n\
+};\n\
+#undef CLASS_DATA\n\
+constexpr size_t class_size = std::size(class_list);\n\
+\n\
+// leading input byte selects class\n\
+constexpr bool class_selector = %2$s;\n\
+\n\
+// chain of class starts with byte dealing calls to workers (concurrent mode)\n\
+constexpr bool worker_selector = %7$s;\n\
+\n\
+// Runtime section\n\
+\n\
+// ids are global there: classes take consecutive ranges in class_list order\n\
+const char *cfuzz::call_name(CallKind kind, size_t id) {\n\
+    for (const ClassData &c : class_list) {\n\
+        const size_t n = kind == CALL_CONSTR ? c.constr_size : c.method_size;\n\
+        if (id < n)\n\
+            return c.call_name(kind, id);\n\
+        id -= n;\n\
     }\n\
+    return \"?\";\n\
+}\n\
 \n\
+size_t cfuzz::call_arg_size(CallKind kind, size_t id) {\n\
+    for (const ClassData &c : class_list) {\n\
+        const size_t n = kind == CALL_CONSTR ? c.constr_size : c.method_size;\n\
+        if (id < n)\n\
+            return c.call_arg_size(kind, id);\n\
+        id -= n;\n\
+    }\n\
     return 0;\n\
 }\n\
+\n\
+#ifdef CFUZZ_PROFILE\n\
+const bool profile_registered = cfuzz::profile_register(%3$zu, %4$zu);\n\
+#endif\n\
+\n\
+#ifdef CFUZZ_ALLOC\n\
+const bool alloc_registered = cfuzz::alloc_register(%3$zu, %4$zu);\n\
+#endif\n\
+\n\
+// Run one chain, shared by all entry points\n\
+int run_chain(const uint8_t *data, size_t size) {\n\
+    if (!class_selector)\n\
+        return class_list[0].run(data, size);\n\
+\n\
+    if (size == 0)\n\
+        return 0;\n\
+    return class_list[data[0] %% class_size].run(data + 1, size - 1);\n\
+}\n\
+\n\
+// Rewrite input in place to canonical form (see cfuzz.hpp), returns new size\n\
+size_t canonical_chain(uint8_t *data, size_t size) {\n\
+    if (!class_selector)\n\
+        return class_list[0].canonical(data, size);\n\
+\n\
+    if (size == 0)\n\
+        return 0;\n\
+    data[0] %%= class_size;\n\
+    const size_t chain_size = class_list[data[0]].canonical(data + 1, size - 1);\n\
+    return chain_size ? chain_size + 1 : 0;\n\
+}\n\
+";
+
+/// namespace
+const char *CLASS_ITEM = " X(fuzz_%s)";
+
+/// Entry points, CFUZZ_NO_ENTRY leaves only tables and run_chain
+/// (for mutators and tools that include harness)
+
+const char *LIBFUZZER_ENTRY =
+"\n\
+#ifndef CFUZZ_NO_ENTRY\n\
+extern \"C\" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {\n\
+    return run_chain(data, size);\n\
+}\n\
+#endif\n\
+";
+
+const char *AFL_ENTRY =
+"\n\
+#ifndef CFUZZ_NO_ENTRY\n\
+#include <unistd.h>\n\
+\n\
+// Without afl-clang-fast just run input from stdin once\n\
+#ifndef __AFL_FUZZ_TESTCASE_LEN\n\
+ssize_t fuzz_len;\n\
+unsigned char fuzz_buf[1024000];\n\
+#define __AFL_FUZZ_TESTCASE_LEN fuzz_len\n\
+#define __AFL_FUZZ_TESTCASE_BUF fuzz_buf\n\
+#define __AFL_FUZZ_INIT() void sync(void);\n\
+#define __AFL_LOOP(x) ((fuzz_len = read(0, fuzz_buf, sizeof(fuzz_buf))) > 0 ? 1 : 0)\n\
+#define __AFL_INIT() sync()\n\
+#endif\n\
+\n\
+__AFL_FUZZ_INIT();\n\
+\n\
+int main() {\n\
+    // static setup is done by now, so fork server starts from here\n\
+#ifdef __AFL_HAVE_MANUAL_CONTROL\n\
+    __AFL_INIT();\n\
+#endif\n\
+\n\
+    // shared memory testcase, must be taken after __AFL_INIT\n\
+    unsigned char *buf = __AFL_FUZZ_TESTCASE_BUF;\n\
+\n\
+    while (__AFL_LOOP(100000))\n\
+        run_chain(buf, __AFL_FUZZ_TESTCASE_LEN);\n\
+\n\
+    return 0;\n\
+}\n\
+#endif\n\
 ";
 
 /// 1 = class name
 /// 2 = i
+/// 3 = constructor or static factory
+/// 4 = template head of class template wrapper
 const char *CONSTR_FN_NOARGS =
 "\n\
-%1$s constr_%2$d(const uint8_t *data) {\n\
-    return %1$s();\n\
+%4$s%1$s constr_%2$d(const uint8_t *data) {\n\
+    CFUZZ_PROFILE_CALL(CALL_CONSTR, constr_base + %2$d);\n\
+    CFUZZ_ALLOC_CALL(CALL_CONSTR, constr_base + %2$d);\n\
+    return %3$s();\n\
 }\n\
 ";
 
@@ -310,18 +1489,30 @@ const char *CONSTR_FN_NOARGS =
 /// 2 = i
 /// 3 = args
 /// 4 = call args
+/// 5 = constructor or static factory
+/// 6 = template head
 const char *CONSTR_FN =
 "\n\
-%1$s constr_%2$d(const uint8_t *data) {\n\
+%6$s%1$s constr_%2$d(const uint8_t *data) {\n\
+    CFUZZ_PROFILE_CALL(CALL_CONSTR, constr_base + %2$d);\n\
+    CFUZZ_ALLOC_CALL(CALL_CONSTR, constr_base + %2$d);\n\
     size_t size = 0;\n\
 \n\
     // args\n\
 %3$s\n\
     // call\n\
-    return %1$s(%4$s);\n\
+    return %5$s(%4$s);\n\
 }\n\
 ";
 
+/// 1 = parameter name
+/// 2 = argument
+const char *TEMPLATE_TYPE_ARG = "using %1$s = %2$s;\n";
+
+/// 1 = parameter
+/// 2 = argument
+const char *TEMPLATE_VALUE_ARG = "constexpr %1$s = %2$s;\n";
+
 /// 1 = type
 /// 2 = i
 const char *FN_ARG = 
@@ -333,13 +1524,17 @@ const char *FN_ARG =
 const char *FN_CALL_ARG = "*arg_%d, ";
 const char *FN_CALL_ARG_LAST = "*arg_%d";
 
+/// 1 = class name
+/// 2 = arg types
+const char *CONSTR_NAME_ITEM = "    \"%1$s(%2$s)\",\n";
+
 /// 1 = + sizeof args
-/// 2 = i
+/// 2 = wrapper
 const char *CONSTR_LIST_ITEM =
 "\n\
     {\n\
         .arg_size = 0%1$s,\n\
-        .fn = constr_%2$d\n\
+        .fn = %2$s\n\
     },\n\
 ";
 
@@ -348,237 +1543,1020 @@ const char *SIZE_ARG = " + sizeof(%s)";
 const char *SIZE_ARG_LAST = "sizeof(%s)";
 
 /// 1 = method name
-/// 2 = class name
+/// 2 = object type
+/// 3 = global id ("method_base + i", or "id" for shared wrapper)
+/// 4 = return capture prefix
+/// 5 = return capture suffix
+/// 6 = callee prefix ("obj->", or "Class::" for static call)
+/// 7 = wrapper key
+/// 8 = id parameter of shared wrapper
+/// 9 = template head
 const char *METHOD_FN_NOARGS =
 "\n\
-void method_%1$s(%2$s *obj, const uint8_t *data) {\n\
+%9$svoid method_%7$s(%2$s *obj, const uint8_t *data%8$s) {\n\
+    CFUZZ_PROFILE_CALL(CALL_METHOD, %3$s);\n\
+    CFUZZ_ALLOC_CALL(CALL_METHOD, %3$s);\n\
     // call\n\
-    obj->%1$s();\n\
+    %4$s%6$s%1$s()%5$s;\n\
 }\n\
 ";
 
 /// 1 = method name
-/// 2 = class name
+/// 2 = object type
 /// 3 = args
 /// 4 = call args
+/// 5 = global id
+/// 6 = return capture prefix
+/// 7 = return capture suffix
+/// 8 = callee prefix
+/// 9 = wrapper key
+/// 10 = id parameter of shared wrapper
+/// 11 = template head
 const char *METHOD_FN =
 "\n\
-void method_%1$s(%2$s *obj, const uint8_t *data) {\n\
+%11$svoid method_%9$s(%2$s *obj, const uint8_t *data%10$s) {\n\
+    CFUZZ_PROFILE_CALL(CALL_METHOD, %5$s);\n\
+    CFUZZ_ALLOC_CALL(CALL_METHOD, %5$s);\n\
     size_t size = 0;\n\
 \n\
     // args\n\
 %3$s\n\
     // call\n\
-    obj->%1$s(%4$s);\n\
+    %6$s%8$s%1$s(%4$s)%7$s;\n\
 }\n\
 ";
 
+/// Shared wrappers of inherited method get global id of calling class
+const char *SHARED_ID_PARAM = ", [[maybe_unused]] size_t id";
+
+/// 1 = wrapper key
+/// 2 = object type
+/// 3 = namespace suffix of base wrappers
+/// 4 = i
+const char *METHOD_FN_INHERITED =
+"\n\
+void method_%1$s(%2$s *obj, const uint8_t *data) {\n\
+    fuzz_base_%3$s::method_%1$s(obj, data, method_base + %4$zu);\n\
+}\n\
+";
+
+/// 1 = class template (chain name)
+/// 2 = namespace suffix (template, or implementation_template in diff mode)
+/// 3 = constructor and method fns
+/// 4 = template parameters
+/// 5 = template arguments
+/// 6 = object type
+/// 7 = constructor list
+/// 8 = method list
+/// 9 = method meta list
+/// 10 = run_chain body
+const char *TEMPLATE_CORE =
+"\n\
+///////////////////////////// template %1$s /////////////////////////////\n\
+\n\
+// Wrappers, tables and run_chain of %1$s, each instantiation binds them in its namespace\n\
+namespace fuzz_tpl_%2$s {\n\
+%3$s\n\
+// Chain of one instantiation: its first global ids and names of its calls\n\
+template <size_t constr_base, size_t method_base, const auto &constr_names, const auto &method_names, %4$s>\n\
+struct Chain {\n\
+    struct ConstrData {\n\
+        size_t arg_size;\n\
+        %6$s (*fn)(const uint8_t *);\n\
+    };\n\
+\n\
+    struct MethodData {\n\
+        size_t arg_size;\n\
+        void (*fn)(%6$s *, const uint8_t *);\n\
+        // const, so obj state can't change\n\
+        bool pure;\n\
+    };\n\
+\n\
+    // Tables section (hot tables go together)\n\
+\n\
+    static constexpr ConstrData constr_list[] = {\n\
+%7$s    };\n\
+    static constexpr size_t constr_size = std::size(constr_list);\n\
+\n\
+    static constexpr MethodData method_list[] = {\n\
+%8$s    };\n\
+    static constexpr size_t method_size = std::size(method_list);\n\
+\n\
+    // Metadata section\n\
+\n\
+    static constexpr MethodMeta method_meta[] = {\n\
+%9$s    };\n\
+\n\
+    static const char *call_name(cfuzz::CallKind kind, size_t id) {\n\
+        return kind == cfuzz::CALL_CONSTR ? constr_names[id] : method_names[id];\n\
+    }\n\
+\n\
+    static size_t call_arg_size(cfuzz::CallKind kind, size_t id) {\n\
+        return kind == cfuzz::CALL_CONSTR ? constr_list[id].arg_size : method_list[id].arg_size;\n\
+    }\n\
+\n\
+    static int run_chain(const uint8_t *data, size_t size);\n\
+};\n\
+\n\
+// Run one chain of instantiation\n\
+template <size_t constr_base, size_t method_base, const auto &constr_names, const auto &method_names, %4$s>\n\
+int Chain<constr_base, method_base, constr_names, method_names, %5$s>::run_chain(const uint8_t *data, size_t size) {\n\
+%10$s}\n\
+\n\
+} // namespace fuzz_tpl_%2$s\n\
+";
+
+/// 1 = class name
+/// 2 = namespace suffix (class name, or implementation_class in diff mode)
+/// 3 = template arguments bound to instantiation
+/// 4 = constructor name list
+/// 5 = method name list
+/// 6 = first global constructor id
+/// 7 = first global method id
+/// 8 = namespace suffix of template
+/// 9 = template arguments
+const char *INSTANCE_CORE =
+"\n\
+///////////////////////////// %1$s /////////////////////////////\n\
+\n\
+// Instantiation has own ids and names, its tables and run_chain come from template chain\n\
+namespace fuzz_%2$s {\n\
+\n\
+%3$sconst char *const class_name = \"%1$s\";\n\
+\n\
+// first global ids of this class, see call_name in runtime section\n\
+constexpr size_t constr_base = %6$zu;\n\
+constexpr size_t method_base = %7$zu;\n\
+\n\
+const char *const constr_names[] = {\n\
+%4$s};\n\
+\n\
+const char *const method_names[] = {\n\
+%5$s};\n\
+\n\
+using Chain = fuzz_tpl_%8$s::Chain<constr_base, method_base, constr_names, method_names, %9$s>;\n\
+using ConstrData = Chain::ConstrData;\n\
+using MethodData = Chain::MethodData;\n\
+constexpr auto &constr_list = Chain::constr_list;\n\
+constexpr size_t constr_size = Chain::constr_size;\n\
+constexpr auto &method_list = Chain::method_list;\n\
+constexpr size_t method_size = Chain::method_size;\n\
+constexpr auto &method_meta = Chain::method_meta;\n\
+constexpr auto call_name = Chain::call_name;\n\
+constexpr auto call_arg_size = Chain::call_arg_size;\n\
+constexpr auto run_chain = Chain::run_chain;\n\
+\n\
+} // namespace fuzz_%2$s\n\
+";
+
+/// 1 = base class name
+/// 2 = namespace suffix (base class, or implementation_base in diff mode)
+/// 3 = method fns
+const char *BASE_CORE =
+"\n\
+///////////////////////////// base %1$s /////////////////////////////\n\
+\n\
+// Wrappers of methods inherited from %1$s, shared by all derived classes\n\
+namespace fuzz_base_%2$s {\n\
+%3$s\n\
+} // namespace fuzz_base_%2$s\n\
+";
+
+/// Diff mode keeps non-void returns for comparison
+const char *CAPTURE_PREFIX = "cfuzz::diff_capture(";
+const char *CAPTURE_SUFFIX = ")";
+
 /// 1 = + sizeof args
-/// 2 = method name
+/// 2 = wrapper
+/// 3 = pure
 const char *METHOD_LIST_ITEM =
 "\n\
     {\n\
         .arg_size = 0%1$s,\n\
-        .fn = method_%2$s,\n\
+        .fn = %2$s,\n\
+        .pure = %3$s,\n\
     },\n\
 ";
 
-void write_fuzzer(const char *header_name, FuzgenData d, FILE *f) {
-    char *constructor_fns = malloc(1000 * sizeof(char));
-    char *constructor_list= malloc(1000 * sizeof(char));
-    char *method_fns = malloc(1000 * sizeof(char));
-    char *method_list = malloc(1000 * sizeof(char));
-    constructor_fns[0] = '\0';
-    constructor_list[0] = '\0';
-    method_fns[0] = '\0';
-    method_list[0] = '\0';
+/// 1 = method name
+/// 2 = return type
+/// 3 = flags
+const char *METHOD_META_ITEM =
+"    {\"%1$s\", \"%2$s\", %3$s},\n";
 
-    char *args = malloc(1000 * sizeof(char));
-    char *call_args = malloc(1000 * sizeof(char));
+/// flag
+const char *META_FLAG = " | %s";
 
-    /// CONSTRUCTORS
-    for (size_t i = 0; i < d.constr_len; ++i) {
-        // constructors fns
-        if (d.constructors[i].arg_len == 0) {
-            sprintf(
-                constructor_fns + strlen(constructor_fns),
-                CONSTR_FN_NOARGS,
-                d.class_name,
-                i
-            );
-        } else {
-            args[0] = '\0';
-            call_args[0] = '\0';
-
-            for (size_t j = 0; j < d.constructors[i].arg_len; ++j) {
-                sprintf(
-                    args + strlen(args),
-                    FN_ARG,
-                    d.constructors[i].arg_types[j],
-                    j
-                );
-                if (j + 1 != d.constructors[i].arg_len)
-                    sprintf(
-                        call_args + strlen(call_args),
-                        FN_CALL_ARG,
-                        j
-                    );
-                else
-                    sprintf(
-                        call_args + strlen(call_args),
-                        FN_CALL_ARG_LAST,
-                        j
-                    );
-            }
+/// 1 = class name
+/// 2 = method name
+const char *METHOD_NAME_ITEM = "    \"%1$s::%2$s\",\n";
+
+// Room for generated text of one call: template text with names, and text around
+// each argument type (every type is written a few times)
+#define CALL_TEXT_SIZE 2048
+#define ARG_TEXT_SIZE 256
+
+size_t call_text_size(const char **arg_types, size_t arg_len) {
+    size_t n = CALL_TEXT_SIZE;
+    for (size_t j = 0; j < arg_len; ++j)
+        n += ARG_TEXT_SIZE + 4 * strlen(arg_types[j]);
+    return n;
+}
 
-            // write
-            sprintf(
-                constructor_fns + strlen(constructor_fns),
-                CONSTR_FN,
-                d.class_name,
-                i,
-                args,
-                call_args
-            );
-        }
+size_t method_text_size(const MethodInfo *m) {
+    return call_text_size(m->arg_types, m->arg_len) + 4 * (strlen(m->name) + strlen(m->return_type) + strlen(m->owner));
+}
 
-        // call args
+// Room for everything of one class
+size_t class_text_size(FuzgenData d) {
+    size_t n = CALL_TEXT_SIZE;
+    for (size_t i = 0; i < d.constr_len; ++i)
+        n += call_text_size(d.constructors[i].arg_types, d.constructors[i].arg_len);
+    for (size_t i = 0; i < d.method_len; ++i)
+        n += method_text_size(&d.methods[i]);
+    return n;
+}
+
+// Wrapper name: spelling made identifier (operators too) and hash of owner and signature,
+// so overloads don't clash and base method has same key in every derived class
+void method_key(char *out, size_t size, const MethodInfo *m) {
+    Hash h = 0xcbf29ce484222325ull;
+    h = hash_str(h, m->owner);
+    h = hash_str(h, m->name);
+    for (size_t j = 0; j < m->arg_len; ++j)
+        h = hash_str(h, m->arg_types[j]);
+    h = hash_bytes(h, &m->is_const, sizeof(m->is_const));
+
+    format_name(out, size, "%s_%08llx", m->name, h & 0xffffffffull);
+    for (char *c = out; *c; ++c)
+        if (!isalnum((unsigned char)*c))
+            *c = '_';
+}
+
+// Non-static method of base class gets its wrapper in shared base section
+// (class template calls them through its own wrappers, base of template may depend on its parameters)
+int is_inherited(const MethodInfo *m, FuzgenData d) {
+    return !m->is_static && !d.template_params && strcmp(m->owner, d.class_name) != 0;
+}
+
+// impl_Class: suffix of namespace with generated code of class (impl may be NULL)
+void class_ident(char *out, size_t size, const char *impl, const char *class_name) {
+    format_name(out, size, "%s%s%s", impl ? impl : "", impl ? "_" : "", class_name);
+    size_t len = 0;
+    for (const char *c = out; *c; ++c) {
+        if (isalnum((unsigned char)*c))
+            out[len++] = *c;
+        else if (len && out[len - 1] != '_')
+            out[len++] = '_';
+    }
+    while (len && out[len - 1] == '_')
+        --len;
+    out[len] = '\0';
+}
+
+// Class name without template arguments
+void template_name(char *out, size_t size, const char *class_name) {
+    format_name(out, size, "%.*s", (int)template_name_len(class_name), class_name);
+}
+
+// Next item of comma separated list (commas in <>, () and [] don't count),
+// NULL after last one
+const char *next_item(const char *s, char *out, size_t size) {
+    while (*s == ' ')
+        ++s;
+    int depth = 0;
+    size_t len = 0;
+    for (; *s && !(depth == 0 && *s == ','); ++s) {
+        depth += *s == '<' || *s == '(' || *s == '[';
+        depth -= *s == '>' || *s == ')' || *s == ']';
+        if (len + 1 == size)
+            name_too_long(s, size);
+        out[len++] = *s;
+    }
+    while (len && out[len - 1] == ' ')
+        --len;
+    out[len] = '\0';
+    return *s ? s + 1 : 0;
+}
+
+// "T, N" of "typename T, size_t N"
+void template_args(char *out, size_t size, const char *params) {
+    char param[1024];
+    out[0] = '\0';
+    for (const char *p = params; p && *p;) {
+        p = next_item(p, param, sizeof(param));
+        const char *name = strrchr(param, ' ');
+        format_name(out + strlen(out), size - strlen(out), "%s%s", out[0] ? ", " : "", name ? name + 1 : param);
+    }
+}
+
+// Parameters of template bound to arguments of instantiation in class_name, 1 if counts differ
+int template_bindings(char *out, size_t size, const char *params, const char *class_name) {
+    char param[1024], arg[1024];
+    const char *a = strchr(class_name, '<');
+    if (!a || !strrchr(a, '>'))
+        return 1;
+    char *args = strndup(a + 1, strrchr(a, '>') - a - 1);
+
+    out[0] = '\0';
+    const char *p = params;
+    a = args;
+    while (p && *p && a && *a) {
+        p = next_item(p, param, sizeof(param));
+        a = next_item(a, arg, sizeof(arg));
+        if (strncmp(param, "typename ", 9) == 0)
+            format_name(out + strlen(out), size - strlen(out), TEMPLATE_TYPE_ARG, param + 9, arg);
+        else
+            format_name(out + strlen(out), size - strlen(out), TEMPLATE_VALUE_ARG, param, arg);
+    }
+    const int error = (p && *p) || (a && *a);
+    free(args);
+    return error;
+}
+
+// Static method returning class by value also constructs objects
+int is_factory(const MethodInfo *m, const char *class_name) {
+    return m->is_static && returns_class(m->return_type, class_name);
+}
+
+// Constructors and static factories of object chain
+size_t object_constr_len(FuzgenData d) {
+    size_t n = d.constr_len;
+    for (size_t i = 0; i < d.method_len; ++i)
+        n += is_factory(&d.methods[i], d.class_name);
+    return n;
+}
+
+// Methods of object chain (static ones go to static calls)
+size_t object_method_len(FuzgenData d) {
+    size_t n = 0;
+    for (size_t i = 0; i < d.method_len; ++i)
+        n += !d.methods[i].is_static;
+    return n;
+}
+
+size_t static_method_len(FuzgenData d) {
+    return d.method_len - object_method_len(d);
+}
+
+// Class gets object chain if there is something to construct and call,
+// and separate chain of static calls (without object) if it has static methods
+int has_object_chain(FuzgenData d) {
+    return object_constr_len(d) > 0 && object_method_len(d) > 0;
+}
+
+int has_static_chain(FuzgenData d) {
+    return static_method_len(d) > 0;
+}
+
+// sizeof args to out
+void write_arg_sizes(char *out, const char **arg_types, size_t arg_len) {
+    out[0] = '\0';
+    for (size_t j = 0; j < arg_len; ++j)
+        sprintf(out + strlen(out), SIZE_ARG, arg_types[j]);
+}
+
+// Where wrappers go: plain class keeps them in its namespace, class template has them
+// once as templates (head), and tables of each instantiation name them with
+// namespace prefix and template arguments suffix
+typedef struct {
+    char head[2048];
+    char prefix[1024];
+    char suffix[2048];
+} WrapperScope;
+
+const WrapperScope PLAIN_SCOPE = {"", "", ""};
+
+// Wrapper of constructor (or factory) i calling callee
+void write_constr(const WrapperScope *scope, const char *type, const char *callee, const char *name,
+                  const char **arg_types, size_t arg_len, size_t i,
+                  char *args, char *call_args, char *fns, char *list, char *names) {
+    if (arg_len == 0) {
+        sprintf(fns + strlen(fns), CONSTR_FN_NOARGS, type, (int)i, callee, scope->head);
+    } else {
         args[0] = '\0';
-        if (d.constructors[i].arg_len != 0) {
-            for (size_t j = 0; j < d.constructors[i].arg_len - 1; ++j) {
-                sprintf(
-                    args + strlen(args),
-                    SIZE_ARG,
-                    d.constructors[i].arg_types[j]
-                );
-            }
-            sprintf(
-                args + strlen(args),
-                SIZE_ARG,
-                d.constructors[i].arg_types[d.constructors[i].arg_len - 1]
-            );
+        call_args[0] = '\0';
+        for (size_t j = 0; j < arg_len; ++j) {
+            sprintf(args + strlen(args), FN_ARG, arg_types[j], (int)j);
+            sprintf(call_args + strlen(call_args), j + 1 != arg_len ? FN_CALL_ARG : FN_CALL_ARG_LAST, (int)j);
         }
+        sprintf(fns + strlen(fns), CONSTR_FN, type, (int)i, args, call_args, callee, scope->head);
+    }
+
+    // constructor list
+    char fn[4096];
+    format_name(fn, sizeof(fn), "%sconstr_%d%s", scope->prefix, (int)i, scope->suffix);
+    write_arg_sizes(args, arg_types, arg_len);
+    sprintf(list + strlen(list), CONSTR_LIST_ITEM, args, fn);
+
+    // constructor names
+    args[0] = '\0';
+    for (size_t j = 0; j < arg_len; ++j)
+        sprintf(args + strlen(args), j ? ", %s" : "%s", arg_types[j]);
+    sprintf(names + strlen(names), CONSTR_NAME_ITEM, name, args);
+}
+
+// Wrapper of method calling callee prefix + name, id is global id expression,
+// shared wrapper takes it as parameter
+void write_method_fn(const WrapperScope *scope, const MethodInfo *m, const char *impl, const char *obj_type,
+                     const char *callee, const char *id, int shared, char *args, char *call_args, char *fns) {
+    const int capture = impl && strcmp(m->return_type, "void") != 0;
+    char key[1024];
+    method_key(key, sizeof(key), m);
 
-        // constructor list
+    if (m->arg_len == 0) {
         sprintf(
-            constructor_list + strlen(constructor_list),
-            CONSTR_LIST_ITEM,
-            args,
-            i
+            fns + strlen(fns),
+            METHOD_FN_NOARGS,
+            m->name,
+            obj_type,
+            id,
+            capture ? CAPTURE_PREFIX : "",
+            capture ? CAPTURE_SUFFIX : "",
+            callee,
+            key,
+            shared ? SHARED_ID_PARAM : "",
+            scope->head
         );
+        return;
+    }
+
+    args[0] = '\0';
+    call_args[0] = '\0';
+    for (size_t j = 0; j < m->arg_len; ++j) {
+        sprintf(args + strlen(args), FN_ARG, m->arg_types[j], (int)j);
+        sprintf(call_args + strlen(call_args), j + 1 != m->arg_len ? FN_CALL_ARG : FN_CALL_ARG_LAST, (int)j);
+    }
+
+    sprintf(
+        fns + strlen(fns),
+        METHOD_FN,
+        m->name,
+        obj_type,
+        args,
+        call_args,
+        id,
+        capture ? CAPTURE_PREFIX : "",
+        capture ? CAPTURE_SUFFIX : "",
+        callee,
+        key,
+        shared ? SHARED_ID_PARAM : "",
+        scope->head
+    );
+}
+
+// Inherited methods of all classes, each once (same key is same base method), 
+// returns count. Out needs room for all methods.
+size_t collect_inherited(FuzgenData *d, size_t class_len, const MethodInfo **out) {
+    size_t n = 0;
+    char key[1024], other[1024];
+    for (size_t k = 0; k < class_len; ++k) {
+        for (size_t i = 0; i < d[k].method_len; ++i) {
+            const MethodInfo *m = &d[k].methods[i];
+            if (!is_inherited(m, d[k]))
+                continue;
+
+            method_key(key, sizeof(key), m);
+            int seen = 0;
+            for (size_t j = 0; j < n && !seen; ++j) {
+                method_key(other, sizeof(other), out[j]);
+                seen = strcmp(key, other) == 0;
+            }
+            if (!seen)
+                out[n++] = m;
+        }
+    }
+    return n;
+}
+
+// Method of class d has wrapper in base section when some class of harness inherits it,
+// so base listed in harness too forwards its own methods there and wrapper is written once
+int has_base_wrapper(const MethodInfo *m, FuzgenData d, FuzgenData *all, size_t class_len) {
+    if (is_inherited(m, d))
+        return 1;
+    if (m->is_static || d.template_params)
+        return 0;
+
+    char key[1024], other[1024];
+    method_key(key, sizeof(key), m);
+    for (size_t k = 0; k < class_len; ++k) {
+        for (size_t i = 0; i < all[k].method_len; ++i) {
+            if (!is_inherited(&all[k].methods[i], all[k]))
+                continue;
+            method_key(other, sizeof(other), &all[k].methods[i]);
+            if (strcmp(key, other) == 0)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// Shared wrappers of inherited methods, one section per base class
+void write_bases(FuzgenData *d, size_t class_len, const char *impl, FILE *f) {
+    size_t method_len = 0, size = CALL_TEXT_SIZE;
+    for (size_t k = 0; k < class_len; ++k) {
+        method_len += d[k].method_len;
+        size += class_text_size(d[k]);
+    }
+    const MethodInfo **inherited = malloc((method_len + 1) * sizeof(const MethodInfo *));
+    const size_t len = collect_inherited(d, class_len, inherited);
+
+    char *fns = malloc(size);
+    char *args = malloc(size);
+    char *call_args = malloc(size);
+
+    for (size_t i = 0; i < len; ++i) {
+        // section starts at first method of its base
+        int first = 1;
+        for (size_t j = 0; j < i && first; ++j)
+            first = strcmp(inherited[j]->owner, inherited[i]->owner) != 0;
+        if (!first)
+            continue;
+
+        char type[1024], ident[1024];
+        format_name(type, sizeof(type), "%s%s%s", impl ? impl : "", impl ? "::" : "", inherited[i]->owner);
+        class_ident(ident, sizeof(ident), impl, inherited[i]->owner);
+
+        fns[0] = '\0';
+        for (size_t j = i; j < len; ++j)
+            if (strcmp(inherited[j]->owner, inherited[i]->owner) == 0)
+                write_method_fn(&PLAIN_SCOPE, inherited[j], impl, type, "obj->", "id", 1, args, call_args, fns);
+        fprintf(f, BASE_CORE, type, ident, fns);
+    }
+
+    free(fns);
+    free(args);
+    free(call_args);
+    free(inherited);
+}
+
+// Copy of text with one more level of indentation (preprocessor lines stay), caller frees
+char *indent_text(const char *text) {
+    size_t lines = 1;
+    for (const char *c = text; *c; ++c)
+        lines += *c == '\n';
+    char *out = malloc(strlen(text) + 4 * lines + 1);
+    size_t len = 0;
+    for (const char *line = text; *line;) {
+        const char *end = strchr(line, '\n');
+        end = end ? end + 1 : line + strlen(line);
+        if (*line != '\n' && *line != '#') {
+            memcpy(out + len, "    ", 4);
+            len += 4;
+        }
+        memcpy(out + len, line, end - line);
+        len += end - line;
+        line = end;
+    }
+    out[len] = '\0';
+    return out;
+}
+
+// impl is namespace of implementation in diff mode, NULL otherwise.
+// statics picks chain: static methods without object, or object chain otherwise.
+// Class template instantiation writes shared template wrappers only if it is first one of its template.
+// all are classes of harness, their inherited methods have wrappers in base sections
+void write_class(FuzgenData d, FuzgenData *all, size_t class_len, const char *impl, int statics,
+                 int first_instance, size_t constr_base, size_t method_base, FILE *f) {
+    const size_t size = class_text_size(d);
+    char *constructor_fns = malloc(size);
+    char *constructor_list= malloc(size);
+    char *method_fns = malloc(size);
+    char *method_list = malloc(size);
+    char *method_meta = malloc(size);
+    char *constructor_names = malloc(size);
+    char *method_names = malloc(size);
+    char *template_fns = malloc(size);
+    constructor_fns[0] = '\0';
+    constructor_list[0] = '\0';
+    method_fns[0] = '\0';
+    method_list[0] = '\0';
+    method_meta[0] = '\0';
+    constructor_names[0] = '\0';
+    method_names[0] = '\0';
+    template_fns[0] = '\0';
+
+    char *args = malloc(size);
+    char *call_args = malloc(size);
+
+    // impl::Class in code, static chain is Class::static
+    char type[1024], ident[1024], name[1024], callee[4096];
+    format_name(type, sizeof(type), "%s%s%s", impl ? impl : "", impl ? "::" : "", d.class_name);
+    class_ident(ident, sizeof(ident), impl, d.class_name);
+    format_name(name, sizeof(name), "%s%s", type, statics ? "::static" : "");
+    if (statics)
+        format_name(ident + strlen(ident), sizeof(ident) - strlen(ident), "_static");
+    const char *obj_type = statics ? "cfuzz::NoObject" : type;
+
+    // class template: wrappers and chain use impl::Template<T, N>, instantiation binds T and N in its namespace
+    char fn_type[2048], tpl_ident[1024], tpl_name[2048], tpl_args[1024], bindings[4096] = "";
+    WrapperScope scope = PLAIN_SCOPE;
+    if (d.template_params) {
+        char tpl[1024];
+        template_name(tpl, sizeof(tpl), d.class_name);
+        template_args(tpl_args, sizeof(tpl_args), d.template_params);
+        template_bindings(bindings, sizeof(bindings), d.template_params, d.class_name);
+        format_name(bindings + strlen(bindings), sizeof(bindings) - strlen(bindings), "\n");
+        format_name(fn_type, sizeof(fn_type), "%s%s%s<%s>", impl ? impl : "", impl ? "::" : "", tpl, tpl_args);
+        class_ident(tpl_ident, sizeof(tpl_ident), impl, tpl);
+        format_name(tpl_name, sizeof(tpl_name), "%s%s", fn_type, statics ? "::static" : "");
+        if (statics)
+            format_name(tpl_ident + strlen(tpl_ident), sizeof(tpl_ident) - strlen(tpl_ident), "_static");
+
+        format_name(scope.head, sizeof(scope.head), "template <size_t constr_base, size_t method_base, %s>\n",
+                 d.template_params);
+        format_name(scope.prefix, sizeof(scope.prefix), "fuzz_tpl_%s::", tpl_ident);
+        format_name(scope.suffix, sizeof(scope.suffix), "<constr_base, method_base, %s>", tpl_args);
+    } else {
+        format_name(fn_type, sizeof(fn_type), "%s", type);
+    }
+    char *const fns_of_constr = d.template_params ? template_fns : constructor_fns;
+    char *const fns_of_method = d.template_params ? template_fns : method_fns;
+    const char *const fn_obj_type = statics ? obj_type : fn_type;
+
+    /// CONSTRUCTORS
+    size_t n = 0;
+    if (statics) {
+        write_constr(&scope, obj_type, obj_type, name, 0, 0, n++, args, call_args,
+                     fns_of_constr, constructor_list, constructor_names);
+    } else {
+        for (size_t i = 0; i < d.constr_len; ++i)
+            write_constr(&scope, fn_type, fn_type, type, d.constructors[i].arg_types, d.constructors[i].arg_len, n++,
+                         args, call_args, fns_of_constr, constructor_list, constructor_names);
+
+        // static factories
+        for (size_t i = 0; i < d.method_len; ++i) {
+            if (!is_factory(&d.methods[i], d.class_name))
+                continue;
+            char factory[2048];
+            format_name(callee, sizeof(callee), "%s::%s", fn_type, d.methods[i].name);
+            format_name(factory, sizeof(factory), "%s::%s", type, d.methods[i].name);
+            write_constr(&scope, fn_type, callee, factory, d.methods[i].arg_types, d.methods[i].arg_len, n++,
+                         args, call_args, fns_of_constr, constructor_list, constructor_names);
+        }
     }
 
     /// METHODS
+    format_name(callee, sizeof(callee), "%s::", fn_type);
+    n = 0;
     for (size_t i = 0; i < d.method_len; ++i) {
-        // method fns
-        if (d.methods[i].arg_len == 0) {
-            sprintf(
-                method_fns + strlen(method_fns),
-                METHOD_FN_NOARGS,
-                d.methods[i].name,
-                d.class_name
-            );
+        const MethodInfo *m = &d.methods[i];
+        if (m->is_static != statics)
+            continue;
+
+        // method fns, inherited ones forward to shared wrapper of base
+        char key[1024], id[64], fn[4096];
+        method_key(key, sizeof(key), m);
+        format_name(fn, sizeof(fn), "%smethod_%s%s", scope.prefix, key, scope.suffix);
+        if (has_base_wrapper(m, d, all, class_len)) {
+            char base_ident[1024];
+            class_ident(base_ident, sizeof(base_ident), impl, m->owner);
+            sprintf(method_fns + strlen(method_fns), METHOD_FN_INHERITED, key, obj_type, base_ident, n);
         } else {
-            args[0] = '\0';
-            call_args[0] = '\0';
-
-            for (size_t j = 0; j < d.methods[i].arg_len; ++j) {
-                sprintf(
-                    args + strlen(args),
-                    FN_ARG,
-                    d.methods[i].arg_types[j],
-                    j
-                );
-                if (j + 1 != d.methods[i].arg_len)
-                    sprintf(
-                        call_args + strlen(call_args),
-                        FN_CALL_ARG,
-                        j
-                    );
-                else
-                    sprintf(
-                        call_args + strlen(call_args),
-                        FN_CALL_ARG_LAST,
-                        j
-                    );
-            }
-
-            // write
-            sprintf(
-                method_fns + strlen(method_fns),
-                METHOD_FN,
-                d.methods[i].name,
-                d.class_name,
-                args,
-                call_args
-            );
+            format_name(id, sizeof(id), "method_base + %zu", n);
+            write_method_fn(&scope, m, impl, fn_obj_type, statics ? callee : "obj->", id, 0,
+                            args, call_args, fns_of_method);
         }
 
         // call args
-        args[0] = '\0';
-        if (d.methods[i].arg_len != 0) {
-            for (size_t j = 0; j < d.methods[i].arg_len - 1; ++j) {
-                sprintf(
-                    args + strlen(args),
-                    SIZE_ARG,
-                    d.methods[i].arg_types[j]
-                );
-            }
-            sprintf(
-                args + strlen(args),
-                SIZE_ARG,
-                d.methods[i].arg_types[d.methods[i].arg_len - 1]
-            );
-        }
+        write_arg_sizes(args, m->arg_types, m->arg_len);
 
         // method list
         sprintf(
             method_list + strlen(method_list),
             METHOD_LIST_ITEM,
             args,
-            d.methods[i].name
+            fn,
+            m->is_const ? "true" : "false"
+        );
+
+        // method meta
+        sprintf(args, "0");
+        if (m->is_const)
+            sprintf(args + strlen(args), META_FLAG, "METHOD_CONST");
+        if (m->is_static)
+            sprintf(args + strlen(args), META_FLAG, "METHOD_STATIC");
+        if (m->is_noexcept)
+            sprintf(args + strlen(args), META_FLAG, "METHOD_NOEXCEPT");
+
+        sprintf(
+            method_meta + strlen(method_meta),
+            METHOD_META_ITEM,
+            m->name,
+            m->return_type,
+            args
+        );
+
+        // method names
+        sprintf(
+            method_names + strlen(method_names),
+            METHOD_NAME_ITEM,
+            type,
+            m->name
         );
+        n += 1;
     }
 
-    fprintf(f, CORE, 
-        header_name,
-        d.class_name,
-        constructor_fns,
-        constructor_list,
-        method_fns,
-        method_list
-    );
+    if (d.template_params) {
+        // tables of instantiations differ only in names, so they are members of template chain
+        if (first_instance) {
+            char *constr_items = indent_text(constructor_list);
+            char *method_items = indent_text(method_list);
+            char *meta_items = indent_text(method_meta);
+            fprintf(f, TEMPLATE_CORE,
+                tpl_name,
+                tpl_ident,
+                template_fns,
+                d.template_params,
+                tpl_args,
+                fn_obj_type,
+                constr_items,
+                method_items,
+                meta_items,
+                RUN_CHAIN_BODY
+            );
+            free(constr_items);
+            free(method_items);
+            free(meta_items);
+        }
+        fprintf(f, INSTANCE_CORE,
+            name,
+            ident,
+            bindings,
+            constructor_names,
+            method_names,
+            constr_base,
+            method_base,
+            tpl_ident,
+            tpl_args
+        );
+    } else {
+        fprintf(f, CLASS_CORE,
+            name,
+            constructor_fns,
+            constructor_list,
+            method_fns,
+            method_list,
+            method_meta,
+            constructor_names,
+            method_names,
+            constr_base,
+            method_base,
+            ident,
+            obj_type,
+            RUN_CHAIN_BODY
+        );
+    }
 
     free(constructor_fns);
     free(constructor_list);
     free(method_fns);
     free(method_list);
+    free(method_meta);
+    free(constructor_names);
+    free(method_names);
+    free(template_fns);
     free(args);
     free(call_args);
 }
 
+// Class k isn't instantiation of template that some earlier class instantiates
+int first_instance(FuzgenData *d, size_t k) {
+    char name[1024], other[1024];
+    template_name(name, sizeof(name), d[k].class_name);
+    for (size_t i = 0; i < k && d[k].template_params; ++i) {
+        template_name(other, sizeof(other), d[i].class_name);
+        if (d[i].template_params && strcmp(name, other) == 0 && strcmp(d[k].template_params, d[i].template_params) == 0)
+            return 0;
+    }
+    return 1;
+}
+
+// More than one class gets leading class selector byte in input.
+// diff is "<impl_a>,<impl_b>" for differential harness, NULL otherwise;
+// workers > 0 gives concurrent harness, split picks wire format
+void write_fuzzer(const char *header_name, FuzgenData *d, size_t class_len, Backend backend, const char *diff, size_t workers, int split, Hash signature, FILE *f) {
+    const char *section = diff ? "#define CFUZZ_DIFF\n" : workers ? "#define CFUZZ_CONCURRENT\n" : "";
+    fprintf(f, HEADER, header_name, signature, split ? "true" : "false", section);
+
+    char impl_a[512] = "", impl_b[512] = "";
+    if (diff)
+        sscanf(diff, "%511[^,],%511s", impl_a, impl_b);
+
+    // inherited methods first, derived classes forward to them
+    write_bases(d, class_len, diff ? impl_a : 0, f);
+    if (diff)
+        write_bases(d, class_len, impl_b, f);
+
+    // every class gives object chain and/or static chain, each is one entry of class_list
+    char *class_items = malloc(class_len * 2 * (strlen(CLASS_ITEM) + 1024) + 1);
+    class_items[0] = '\0';
+    size_t chains = 0;
+
+    size_t constr_base = 0, method_base = 0;
+    for (size_t k = 0; k < class_len; ++k) {
+        for (int statics = 0; statics <= 1; ++statics) {
+            if (statics ? !has_static_chain(d[k]) : !has_object_chain(d[k]))
+                continue;
+
+            char ident[1024];
+            class_ident(ident, sizeof(ident), 0, d[k].class_name);
+            if (statics)
+                format_name(ident + strlen(ident), sizeof(ident) - strlen(ident), "_static");
+            const int first = first_instance(d, k);
+
+            if (diff) {
+                // both get same global ids, they are one class for profile and trace
+                write_class(d[k], d, class_len, impl_a, statics, first, constr_base, method_base, f);
+                write_class(d[k], d, class_len, impl_b, statics, first, constr_base, method_base, f);
+
+                char ident_a[1024], ident_b[1024];
+                class_ident(ident_a, sizeof(ident_a), impl_a, ident);
+                class_ident(ident_b, sizeof(ident_b), impl_b, ident);
+                fprintf(f, DIFF_CLASS, ident, impl_a, impl_b, ident_a, ident_b);
+            } else {
+                write_class(d[k], d, class_len, 0, statics, first, constr_base, method_base, f);
+                if (workers)
+                    fprintf(f, CONCURRENT_CLASS, ident, workers, statics ? "cfuzz::NoObject" : d[k].class_name);
+            }
+            constr_base += statics ? 1 : object_constr_len(d[k]);
+            method_base += statics ? static_method_len(d[k]) : object_method_len(d[k]);
+
+            sprintf(class_items + strlen(class_items), CLASS_ITEM, ident);
+            chains += 1;
+        }
+    }
+
+    fprintf(f, FOOTER,
+        class_items,
+        chains > 1 ? "true" : "false",
+        constr_base,
+        method_base,
+        workers ? "run_concurrent" : "run_chain",
+        workers ? "canonical_concurrent" : "canonical_chain",
+        workers ? "true" : "false"
+    );
+
+    switch (backend) {
+        case BACKEND_LIBFUZZER:
+            fputs(LIBFUZZER_ENTRY, f);
+            break;
+        case BACKEND_AFL:
+            fputs(AFL_ENTRY, f);
+            break;
+    }
+
+    free(class_items);
+}
+
 ///////////////////////////// MAIN /////////////////////////////
 
+// Write harness unless its signature didn't change, 1 on error
+int emit(const FuzzerArgs *args, const char *header_name, FuzgenData *data, size_t class_len, const char *output) {
+    char bindings[4096];
+    for (size_t k = 0; k < class_len; ++k) {
+        if (!has_object_chain(data[k]) && !has_static_chain(data[k])) {
+            fprintf(stderr, "%s: ", data[k].class_name);
+            return print_error("Nothing to call: no constructor with methods and no static methods");
+        }
+        if (strchr(data[k].class_name, '<') && !data[k].template_params) {
+            fprintf(stderr, "%s: ", data[k].class_name);
+            return print_error("Template template parameters are not supported");
+        }
+        if (data[k].template_params
+            && template_bindings(bindings, sizeof(bindings), data[k].template_params, data[k].class_name)) {
+            fprintf(stderr, "%s: ", data[k].class_name);
+            return print_error("Template arguments don't match parameters (defaults must be given too)");
+        }
+    }
+
+    // Unchanged classes keep old file (and its mtime), so nothing gets rebuilt
+    const double t = now_seconds();
+    const Hash h = signature(header_name, data, class_len, args->backend, args->diff, args->workers, args->split);
+    if (!args->force && manifest_up_to_date(output, h)) {
+        stats.up_to_date++;
+    } else {
+        char tmp_name[4096];
+        snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", output);
+
+        FILE *file = fopen(tmp_name, "w");
+        if (!file)
+            return print_error("Can't write output");
+        write_fuzzer(header_name, data, class_len, args->backend, args->diff, args->workers, args->split, h, file);
+        stats.bytes += ftell(file);
+        fclose(file);
+
+        if (rename(tmp_name, output) != 0)
+            return print_error("Can't write output");
+        manifest_update(output, h);
+        stats.written++;
+    }
+    stats.write += now_seconds() - t;
+    return 0;
+}
+
+// No libclang there, templates are rendered straight from models
+int render_models(const FuzzerArgs *args) {
+    for (int i = 0; i < args->models_n; ++i) {
+        const double t = now_seconds();
+        Model m;
+        if (model_load(args->models[i], &m)) {
+            fprintf(stderr, "%s: ", args->models[i]);
+            return print_error("Can't load model");
+        }
+        stats.load += now_seconds() - t;
+        stats.classes += m.class_len;
+        for (size_t k = 0; k < m.class_len; ++k) {
+            stats.constructors += m.classes[k].constr_len;
+            stats.methods += m.classes[k].method_len;
+        }
+
+        // time.cfm -> time.cpp
+        char output[4096];
+        if (args->models_n == 1) {
+            snprintf(output, sizeof(output), "%s", args->output);
+        } else {
+            const char *slash = strrchr(args->models[i], '/');
+            const char *dot = strrchr(args->models[i], '.');
+            const int stem = dot && (!slash || dot > slash) ? dot - args->models[i] : (int)strlen(args->models[i]);
+            snprintf(output, sizeof(output), "%.*s.cpp", stem, args->models[i]);
+        }
+
+        const int error = emit(args, m.header_path, m.classes, m.class_len, output);
+        model_free(&m);
+        if (error)
+            return 1;
+    }
+    return 0;
+}
+
 int main(const int argc, const char **argv) {
     const FuzzerArgs args = parse_args(argc, argv);
-    if (!args.header_path)
+    if (args.from_model ? args.models_n == 0 : !args.header_path)
         return usage(argv[0]);
 
+    const double start = now_seconds();
+    double t = start;
+
+    if (args.from_model) {
+        const int error = render_models(&args);
+        stats.total = now_seconds() - start;
+        if (!error && args.stats != STATS_NONE)
+            print_stats(args.stats);
+        return error;
+    }
+
     ClangData cdata = init_clang(&args);
     if (!cdata.index)
         return print_error("Error while initializing clang");
+    stats.parse += now_seconds() - t;
+
+    // classes are comma separated (commas of template arguments don't count)
+    size_t class_len = 0;
+    char class_name[1024];
+    for (const char *c = args.class_name; c; ++class_len)
+        c = next_item(c, class_name, sizeof(class_name));
+
+    FuzgenData *data = malloc(class_len * sizeof(FuzgenData));
+    char **class_names = malloc(class_len * sizeof(char *));
+    const char *next = args.class_name;
+    for (size_t k = 0; k < class_len; ++k) {
+        next = next_item(next, class_name, sizeof(class_name));
+        class_names[k] = strdup(class_name);
+
+        t = now_seconds();
+        CXCursor class_cursor = find_class(cdata, class_names[k]);
+        if (clang_Cursor_isNull(class_cursor)) {
+            fprintf(stderr, "%s: ", class_names[k]);
+            return print_error("Class not found");
+        }
+        stats.find += now_seconds() - t;
 
-    CXCursor class_cursor = find_class(cdata, args.class_name);
-    if (clang_Cursor_isNull(class_cursor))
-        return print_error("Class not found");
+        t = now_seconds();
+        data[k] = from_class(class_names[k], class_cursor);
+        stats.extract += now_seconds() - t;
+
+        stats.classes++;
+        stats.constructors += data[k].constr_len;
+        stats.methods += data[k].method_len;
+    }
 
-    FuzgenData data = from_class(args.class_name, class_cursor);
-    
-    FILE *file = fopen("fuzzer.cpp", "w");
-    write_fuzzer(args.header_path, data, file);
-    fclose(file);
+    if (args.model && model_save(args.model, args.header_path, data, class_len))
+        return print_error("Can't write model");
 
-    deinit(&data);
+    if (emit(&args, args.header_path, data, class_len, args.output))
+        return 1;
+
+    for (size_t k = 0; k < class_len; ++k) {
+        deinit(&data[k]);
+        free(class_names[k]);
+    }
+    free(data);
+    free(class_names);
     deinit_clang(cdata);
+
+    stats.total = now_seconds() - start;
+    if (args.stats != STATS_NONE)
+        print_stats(args.stats);
     return 0;
 }
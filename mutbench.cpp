@@ -0,0 +1,234 @@
+/// Mutator throughput benchmark
+///
+/// Built together with generated fuzzer.cpp and class sources, without libFuzzer:
+///   c++ -std=c++20 -O2 -I. mutbench.cpp <class sources> -o cfuzz_mutbench
+///   ./cfuzz_mutbench [--iters=N] [--slack=BYTES] [--calls=10,100,...] > bench.json
+///
+/// Synthetic valid chains of every length (and every class) are mutated over and over
+/// from same starting input, as libFuzzer does with corpus input. Byte level
+/// LLVMFuzzerMutate is deterministic stub, so runs are comparable. Reported as JSON:
+/// mutations per second, rate of outputs over MaxSize (or writing past it) and rate
+/// of outputs that are still whole chains (every byte belongs to decoded call).
+
+#define CFUZZ_NO_ENTRY
+#define CFUZZ_MUTATE_STUB
+#include "mutfuzz.cpp"
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Crossover is benchmarked too once mutfuzz has one
+extern "C" size_t LLVMFuzzerCustomCrossOver(
+    const uint8_t *Data1, size_t Size1,
+    const uint8_t *Data2, size_t Size2,
+    uint8_t *Out, size_t MaxOutSize,
+    unsigned int Seed
+) __attribute__((weak));
+
+///////////////////////////// CHAINS /////////////////////////////
+
+// Valid chain of calls (constructor included) in wire format of harness
+template <const auto &constr_list, const auto &method_list>
+void make_chain(std::mt19937 &rng, size_t calls, std::vector<uint8_t> &out) {
+    std::vector<uint8_t> chain;
+    for (size_t i = 0; i < calls; ++i) {
+        const size_t id = i == 0 ? rng() % std::size(constr_list) : rng() % std::size(method_list);
+        const size_t arg_size = i == 0 ? constr_list[id].arg_size : method_list[id].arg_size;
+        chain.push_back(id);
+        for (size_t j = 0; j < arg_size; ++j)
+            chain.push_back(rng());
+    }
+
+    const size_t start = out.size();
+    out.resize(start + chain.size());
+    if constexpr (split_wire)
+        cfuzz::interleaved_to_split<constr_list, method_list>(chain.data(), chain.size(), out.data() + start);
+    else
+        memcpy(out.data() + start, chain.data(), chain.size());
+}
+
+// Constructor fits and no bytes are left over after last call
+template <const auto &constr_list, const auto &method_list>
+bool whole_chain(const uint8_t *data, size_t size) {
+    cfuzz::ChainReader<split_wire> chain(data, size);
+    cfuzz::Call call;
+    if (!chain.template next<constr_list>(call))
+        return false;
+    while (chain.template next<method_list>(call)) {}
+    return chain.front == chain.back;
+}
+
+#define BENCH_CHAIN(ns) {make_chain<ns::constr_list, ns::method_list>, whole_chain<ns::constr_list, ns::method_list>},
+const struct {
+    void (*make)(std::mt19937 &, size_t, std::vector<uint8_t> &);
+    bool (*whole)(const uint8_t *, size_t);
+} bench_classes[] = {
+    CFUZZ_CLASSES(BENCH_CHAIN)
+};
+#undef BENCH_CHAIN
+
+// Input of class k: selectors, then chain
+std::vector<uint8_t> make_input(std::mt19937 &rng, size_t k, size_t calls) {
+    std::vector<uint8_t> in;
+    if (class_selector)
+        in.push_back(k);
+    if (worker_selector)
+        in.push_back(rng());
+    bench_classes[k].make(rng, calls, in);
+    return in;
+}
+
+bool whole_input(const uint8_t *data, size_t size) {
+    const size_t prefix = class_selector + worker_selector;
+    if (size <= prefix)
+        return false;
+    const size_t k = class_selector ? data[0] % class_size : 0;
+    return bench_classes[k].whole(data + prefix, size - prefix);
+}
+
+///////////////////////////// BENCHMARK /////////////////////////////
+
+// Bytes past MaxSize must stay untouched
+const size_t GUARD_SIZE = 64;
+const uint8_t GUARD_BYTE = 0xa5;
+
+struct Result {
+    size_t calls = 0;
+    size_t bytes = 0;
+    size_t runs = 0;
+    double seconds = 0;
+    size_t over_max_size = 0;
+    size_t whole = 0;
+};
+
+// One output: over MaxSize if it says so or wrote into guard
+void account(Result &r, const std::vector<uint8_t> &buf, size_t size, size_t max_size) {
+    bool over = size > max_size;
+    for (size_t i = max_size; i < max_size + GUARD_SIZE && !over; ++i)
+        over = buf[i] != GUARD_BYTE;
+    r.runs += 1;
+    r.over_max_size += over;
+    r.whole += !over && whole_input(buf.data(), size);
+}
+
+// Each run starts from one of inputs (round robin over classes)
+Result bench_mutator(const std::vector<std::vector<uint8_t>> &inputs, size_t calls, size_t iters, size_t slack) {
+    Result r;
+    r.calls = calls;
+    std::vector<uint8_t> buf;
+    for (size_t i = 0; i < iters; ++i) {
+        const std::vector<uint8_t> &in = inputs[i % inputs.size()];
+        const size_t max_size = in.size() + slack;
+        buf.assign(max_size + GUARD_SIZE, GUARD_BYTE);
+        memcpy(buf.data(), in.data(), in.size());
+
+        const auto start = std::chrono::steady_clock::now();
+        const size_t size = LLVMFuzzerCustomMutator(buf.data(), in.size(), max_size, i);
+        r.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        r.bytes += in.size();
+        account(r, buf, size, max_size);
+    }
+    return r;
+}
+
+Result bench_crossover(const std::vector<std::vector<uint8_t>> &inputs, size_t calls, size_t iters, size_t slack) {
+    Result r;
+    r.calls = calls;
+    std::vector<uint8_t> buf;
+    for (size_t i = 0; i < iters; ++i) {
+        const std::vector<uint8_t> &a = inputs[i % inputs.size()];
+        const std::vector<uint8_t> &b = inputs[(i + 1) % inputs.size()];
+        const size_t max_size = std::max(a.size(), b.size()) + slack;
+        buf.assign(max_size + GUARD_SIZE, GUARD_BYTE);
+
+        const auto start = std::chrono::steady_clock::now();
+        const size_t size = LLVMFuzzerCustomCrossOver(a.data(), a.size(), b.data(), b.size(), buf.data(), max_size, i);
+        r.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        r.bytes += a.size() + b.size();
+        account(r, buf, size, max_size);
+    }
+    return r;
+}
+
+void print_result(const Result &r, bool last) {
+    printf("    {\"calls\": %zu, \"runs\": %zu, \"input_bytes\": %zu, \"seconds\": %.6f, "
+        "\"mutations_per_sec\": %.1f, \"over_max_size\": %zu, \"over_max_size_rate\": %.6f, "
+        "\"whole_chains\": %zu, \"valid_chain_ratio\": %.6f}%s\n",
+        r.calls, r.runs, r.bytes, r.seconds,
+        r.seconds > 0 ? r.runs / r.seconds : 0.0,
+        r.over_max_size, r.runs ? (double)r.over_max_size / r.runs : 0.0,
+        r.whole, r.runs ? (double)r.whole / r.runs : 0.0,
+        last ? "" : ",");
+}
+
+///////////////////////////// MAIN /////////////////////////////
+
+int usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [--iters=N] [--slack=BYTES] [--calls=10,100,...]\n", program_name);
+    return 1;
+}
+
+// Comma separated numbers, false on anything else
+bool parse_lengths(const char *p, std::vector<size_t> &lengths) {
+    lengths.clear();
+    for (;;) {
+        char *end;
+        const size_t n = strtoul(p, &end, 10);
+        if (end == p || !isdigit((unsigned char)*p))
+            return false;
+        lengths.push_back(n);
+        if (*end == '\0')
+            return true;
+        if (*end != ',')
+            return false;
+        p = end + 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t iters = 10000, slack = 64;
+    std::vector<size_t> lengths = {10, 100, 1000, 10000, 100000};
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--iters=", 8) == 0) {
+            iters = strtoul(argv[i] + 8, nullptr, 10);
+        } else if (strncmp(argv[i], "--slack=", 8) == 0) {
+            slack = strtoul(argv[i] + 8, nullptr, 10);
+        } else if (strncmp(argv[i], "--calls=", 8) == 0) {
+            if (!parse_lengths(argv[i] + 8, lengths))
+                return usage(argv[0]);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (iters == 0)
+        iters = 1;
+
+    std::mt19937 rng(0);
+    std::vector<std::vector<std::vector<uint8_t>>> inputs;
+    for (size_t calls : lengths) {
+        inputs.emplace_back();
+        for (size_t k = 0; k < class_size; ++k)
+            inputs.back().push_back(make_input(rng, k, calls ? calls : 1));
+    }
+
+    printf("{\n  \"iters\": %zu,\n  \"slack\": %zu,\n  \"split_wire\": %s,\n  \"call_limit\": %zu,\n",
+        iters, slack, split_wire ? "true" : "false", (size_t)cfuzz::call_limit);
+
+    printf("  \"mutator\": [\n");
+    for (size_t i = 0; i < lengths.size(); ++i)
+        print_result(bench_mutator(inputs[i], lengths[i], iters, slack), i + 1 == lengths.size());
+    printf("  ]");
+
+    if (LLVMFuzzerCustomCrossOver) {
+        printf(",\n  \"crossover\": [\n");
+        for (size_t i = 0; i < lengths.size(); ++i)
+            print_result(bench_crossover(inputs[i], lengths[i], iters, slack), i + 1 == lengths.size());
+        printf("  ]");
+    }
+    printf("\n}\n");
+    return 0;
+}
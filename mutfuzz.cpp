@@ -1,243 +1,221 @@
-/// This file is autogenerated
+/// Custom mutator for call chains
+///
+/// Built together with harness generated by main.c:
+/// it mutates chain with constr_list and method_list of each class from there,
+/// so ids are never mixed between classes. Chains in split wire format are decoded
+/// with reader of cfuzz.hpp, same as harness does.
 
-#include "time.hpp"
+#include "fuzzer.cpp"
 
-#include <cstdint>
-#include <iterator> // for std::size
+#include <cstring>
 #include <random>
+#include <vector>
 
-// Constructor section
-
-struct ConstrData {
-    size_t arg_size;
-    Time (*fn)(const uint8_t *);
-};
-
-
-Time constr_0(const uint8_t *data) {
-    return Time();
-}
-
-Time constr_1(const uint8_t *data) {
-    size_t size = 0;
-
-    // args
-    uint *arg_0 = (uint *)(data + size);
-    size += sizeof(uint);
-
-    // call
-    return Time(*arg_0);
-}
-
-
-const ConstrData constr_list[] = {
-
-    {
-        .arg_size = 0,
-        .fn = constr_0
-    },
-
-    {
-        .arg_size = 0 + sizeof(uint),
-        .fn = constr_1
-    },
-};
-constexpr size_t constr_size = std::size(constr_list);
-
-// Method section
-
-struct MethodData {
-    size_t arg_size;
-    void (*fn)(Time *, const uint8_t *);
-};
-
-
-void method_set(Time *obj, const uint8_t *data) {
-    size_t size = 0;
-
-    // args
-    uint *arg_0 = (uint *)(data + size);
-    size += sizeof(uint);
-
-    // call
-    obj->set(*arg_0);
-}
-
-void method_zero(Time *obj, const uint8_t *data) {
-    // call
-    obj->zero();
-}
-
-void method_get(Time *obj, const uint8_t *data) {
-    // call
-    obj->get();
-}
-
-void method_secs(Time *obj, const uint8_t *data) {
-    // call
-    obj->secs();
-}
-
-void method_is_zero(Time *obj, const uint8_t *data) {
-    // call
-    obj->is_zero();
-}
-
-
-const MethodData method_list[] = {
-
-    {
-        .arg_size = 0 + sizeof(uint),
-        .fn = method_set,
-    },
-
-    {
-        .arg_size = 0,
-        .fn = method_zero,
-    },
+extern "C" size_t LLVMFuzzerMutate(uint8_t *Data, size_t Size, size_t MaxSize);
 
-    {
-        .arg_size = 0,
-        .fn = method_get,
-    },
+// Gadgets: short call subsequences learned from inputs we are asked to mutate.
+// libFuzzer only mutates corpus inputs, and those are ones that gave new coverage.
+// Table is fixed size: slot is picked by hash of call ids, on collision
+// the weaker entry loses one hit and is replaced once it has none left.
 
-    {
-        .arg_size = 0,
-        .fn = method_secs,
-    },
+const size_t GADGET_CALLS = 3;
+const size_t GADGET_BYTES = 32;
+const size_t GADGET_SLOTS = 256;
 
-    {
-        .arg_size = 0,
-        .fn = method_is_zero,
-    },
+struct Gadget {
+    uint32_t hits;
+    uint8_t ids[GADGET_CALLS];
+    uint8_t size;
+    uint8_t bytes[GADGET_BYTES];
 };
-constexpr size_t method_size = std::size(method_list);
-
-extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
-    // supported up to 255 constructors and methods
 
-    // empty string
-    if (size == 0)
-        return 0;
-
-    // get constr id
-    size_t args = 0;
-    auto c = constr_list[data[args] % constr_size];
-    args += 1;
-
-    // check if we have enough space for arguments
-    if (args + c.arg_size > size)
-        return 0;
-
-    // call constructor
-    auto obj = c.fn(data + args);
-    args += c.arg_size;
-
-    // check if we have enough space for method id
-    if (args >= size)
-        return 0;
-
-    // get method
-    auto m = method_list[data[args] % method_size];
-    args += 1;
-
-    while (args + m.arg_size <= size) {
-        // call method
-        m.fn(&obj, data + args);
-        args += m.arg_size;
-
-        // check if we have space for another method
-        if (args >= size)
-            return 0;
+// one table per class
+template <const auto &method_list>
+Gadget gadgets[GADGET_SLOTS];
+
+// Learn gadget starting at call on position i
+template <const auto &method_list>
+void learn_gadget(const uint8_t *Data, size_t Size, size_t i) {
+    cfuzz::ChainReader<false> chain(Data + i, Size - i);
+    cfuzz::Call call;
+    uint8_t ids[GADGET_CALLS];
+    size_t ops[GADGET_CALLS];
+    size_t hash = 0;
+    for (size_t k = 0; k < GADGET_CALLS; ++k) {
+        if (!chain.template next<method_list>(call))
+            return;
+        ids[k] = call.id;
+        ops[k] = call.op;
+        hash = hash * 31 + ids[k];
+    }
+    if (chain.front > GADGET_BYTES)
+        return;
 
-        // get new method
-        m = method_list[data[args] % method_size];
-        args += 1;
+    Gadget &g = gadgets<method_list>[hash % GADGET_SLOTS];
+    if (g.hits != 0 && memcmp(g.ids, ids, GADGET_CALLS) != 0) {
+        g.hits -= 1;
+        return;
     }
 
-    return 0;
+    // keep latest arguments, they come from fresher input
+    g.hits += 1;
+    memcpy(g.ids, ids, GADGET_CALLS);
+    memcpy(g.bytes, Data + i, chain.front);
+    g.size = chain.front;
+    for (size_t k = 0; k < GADGET_CALLS; ++k)
+        g.bytes[ops[k]] = ids[k];
 }
 
-const size_t CHAIN_LIMIT = 10;
+// Pick one of two random gadgets with more hits, NULL if table is empty there
+template <const auto &method_list>
+const Gadget *pick_gadget(std::mt19937 &rng) {
+    const Gadget *a = &gadgets<method_list>[rng() % GADGET_SLOTS];
+    const Gadget *b = &gadgets<method_list>[rng() % GADGET_SLOTS];
+    if (b->hits > a->hits)
+        a = b;
+    return a->hits != 0 ? a : nullptr;
+}
 
-extern "C" size_t LLVMFuzzerMutate(uint8_t *Data, size_t Size, size_t MaxSize);
+// Mutate chain of one class
+template <const auto &constr_list, const auto &method_list>
+size_t mutate_chain(uint8_t *Data, size_t Size, size_t MaxSize, unsigned int Seed) {
+    constexpr size_t method_size = std::size(method_list);
 
-extern "C" size_t LLVMFuzzerCustomMutator(uint8_t *Data, size_t Size, size_t MaxSize, unsigned int Seed) {
     if (Size == 0)
         return 0;
 
+    // Calls are walked with decoder of harness, trailing partial call is not one
+    // (methods start at Size when constructor itself doesn't fit)
+    cfuzz::Call call;
+    cfuzz::ChainReader<false> chain(Data, Size);
+    const size_t methods = chain.template next<constr_list>(call) ? chain.front : Size;
+
     // first we need to know how many there are methods out there
-    size_t count = 1, i = constr_list[Data[0] % constr_size].arg_size + 1;
-    while (i < Size) {
-        i += method_list[Data[i] % method_size].arg_size + 1;
+    size_t count = 1;
+    chain.front = methods;
+    while (chain.template next<method_list>(call))
         count += 1;
-    }
 
     // Now choose one of 4 mutations:
     // - Delete call
     // - Add call (place of insertion is chosen above)
     // - Argument mutation
+    // - Insert learned gadget
     std::mt19937 rng(Seed);
     size_t target = rng() % count;
-    // Skip calls
-    size_t j = 0;
-    i = constr_list[Data[0] % constr_size].arg_size + 1;
-    while (i < Size && j < target) {
-        i += method_list[Data[i] % method_size].arg_size + 1;
-        j += 1;
-    }   
-    switch (rng() % 3) {
+    size_t mutation = rng() % 4;
+
+    // Chain already takes whole call budget of harness, so don't grow it
+    if ((mutation == 1 || mutation == 3) && cfuzz::call_limit && count - 1 >= cfuzz::call_limit) {
+        cfuzz::budget_mutator_hits += 1;
+        mutation = 0;
+    }
+
+    // Skip calls, i is position of target call (or end of whole calls),
+    // prev is position of call before it (Size if that is constructor)
+    size_t prev = Size;
+    chain.front = methods;
+    for (size_t j = 0; j < target && chain.template next<method_list>(call); ++j)
+        prev = call.op;
+    const size_t i = chain.front;
+    learn_gadget<method_list>(Data, Size, i);
+
+    // target call itself, if it is whole
+    const bool whole = chain.template next<method_list>(call);
+
+    switch (mutation) {
         case 0: {
+            // Nothing past end of input, partial call is cut off
+            if (!whole)
+                return i;
+
             // Shift everything past there
-            j = i + method_list[Data[i] % method_size].arg_size + 1;
-            while (j < Size) {
-                Data[i] = Data[j];
-                i++; j++;
-            }
-            return i + 1;
+            memmove(Data + i, Data + chain.front, Size - chain.front);
+            return Size - (chain.front - i);
         }
         case 1: {
-            // Can't shift onto constructor
-            if (target == 0) i += method_list[Data[i] % method_size].arg_size + 1;
-            
-            // Choose fitting call
+            // Choose fitting call, which doesn't repeat neighbouring pure call
+            // (with CFUZZ_SKIP_PURE harness skips such calls, so inserting it is wasted exec)
             size_t call_id = rng() % method_size;
-            while (method_list[call_id].arg_size + 1 >= Size - MaxSize)
+            for (size_t tries = 0; tries < method_size; ++tries) {
+                const size_t next = whole ? call.id : method_size;
+                const size_t before = prev < Size ? Data[prev] % method_size : method_size;
+                const bool fits = Size + method_list[call_id].arg_size + 1 <= MaxSize;
+                const bool redundant = cfuzz::skip_pure_calls && method_list[call_id].pure
+                    && (call_id == next || call_id == before);
+                if (fits && !redundant)
+                    break;
                 call_id = rng() % method_size;
-            
-            // Shift everything out of place
-            const size_t shift_amount = method_list[call_id].arg_size + 1; 
-            j = Size + shift_amount;
-
-            while (j - shift_amount > i) {
-                Data[j] = Data[j - shift_amount];
-                j--;
             }
+            if (Size + method_list[call_id].arg_size + 1 > MaxSize)
+                return Size;
 
-            // Insert call info
+            // Shift everything out of place and insert call info
+            const size_t shift_amount = method_list[call_id].arg_size + 1;
+            memmove(Data + i + shift_amount, Data + i, Size - i);
             Data[i] = call_id;
-            j = i + 1;
-            while (j < i + shift_amount) {
-                Data[j] = 0;
-                j++;
-            }
+            memset(Data + i + 1, 0, shift_amount - 1);
             return Size + shift_amount;
         }
         case 2: {
-            // Problem there: we don't know number of arguments
-            // TODO: solve this (need to change fuzz generation)
-            // But for now...
-            j = method_list[Data[i] % method_size].arg_size;
-            if (j == 0)
+            // Mutate all arguments of target call at once
+            if (!whole || call.arg_size == 0)
                 return Size;
-            // Mutate all arguments at once
-            LLVMFuzzerMutate(Data + i + 1, j, j);
+            LLVMFuzzerMutate(Data + call.args, call.arg_size, call.arg_size);
             return Size;
         }
+        case 3: {
+            // Shift everything out of place and put gadget before target call
+            const Gadget *g = pick_gadget<method_list>(rng);
+            if (!g || Size + g->size > MaxSize)
+                return Size;
+            memmove(Data + i + g->size, Data + i, Size - i);
+            memcpy(Data + i, g->bytes, g->size);
+            return Size + g->size;
+        }
         default: return Size;
     }
 }
 
+// Split chain is mutated interleaved, so calls are edited as a whole
+template <const auto &constr_list, const auto &method_list>
+size_t mutate_wire(uint8_t *Data, size_t Size, size_t MaxSize, unsigned int Seed) {
+    if constexpr (!split_wire) {
+        return mutate_chain<constr_list, method_list>(Data, Size, MaxSize, Seed);
+    } else {
+        static std::vector<uint8_t> chain;
+        chain.resize(MaxSize);
+        cfuzz::split_to_interleaved<constr_list, method_list>(Data, Size, chain.data());
+        Size = mutate_chain<constr_list, method_list>(chain.data(), Size, MaxSize, Seed);
+        cfuzz::interleaved_to_split<constr_list, method_list>(chain.data(), Size, Data);
+        return Size;
+    }
+}
+
+#define MUTATE_CHAIN(ns) mutate_wire<ns::constr_list, ns::method_list>,
+size_t (*const class_mutators[])(uint8_t *, size_t, size_t, unsigned int) = {
+    CFUZZ_CLASSES(MUTATE_CHAIN)
+};
+#undef MUTATE_CHAIN
+
+extern "C" size_t LLVMFuzzerCustomMutator(uint8_t *Data, size_t Size, size_t MaxSize, unsigned int Seed) {
+    // Keep class and worker selectors, so chain is only mutated with ids of that class
+    const size_t prefix = class_selector + worker_selector;
+    if (MaxSize < prefix)
+        return Size;
+    for (; Size < prefix; ++Size)
+        Data[Size] = 0;
+
+    const size_t k = class_selector ? Data[0] % class_size : 0;
+    size_t size = class_mutators[k](Data + prefix, Size - prefix, MaxSize - prefix, Seed) + prefix;
+
+#ifdef CFUZZ_CANONICAL
+    // Inputs stay in canonical form, so same chain is always same input
+    size = canonical_chain(Data, size);
+#endif
+    return size;
+}
+
 // extern "C" size_t LLVMFuzzerCustomCrossOver(
 //     const uint8_t *Data1, size_t Size1,
 //     const uint8_t *Data2, size_t Size2,
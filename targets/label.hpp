@@ -0,0 +1,48 @@
+/// Two implementations of same label for differential harness
+/// (--diff=ref,fast), methods return pointers into object
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+
+namespace ref {
+
+class Label {
+public:
+    Label() : id(0) { name_buf[0] = '\0'; }
+
+    void set(unsigned int v) {
+        id = v;
+        snprintf(name_buf, sizeof(name_buf), "label-%u", v);
+    }
+
+    const char *name() const { return id ? name_buf : nullptr; }
+    const unsigned int *data() const { return &id; }
+private:
+    unsigned int id;
+    char name_buf[32];
+};
+
+} // namespace ref
+
+namespace fast {
+
+class Label {
+public:
+    Label() : len(0), id(0) {}
+
+    void set(unsigned int v) {
+        id = v;
+        len = snprintf(name_buf, sizeof(name_buf), "label-%u", v);
+    }
+
+    const char *name() const { return len && id ? name_buf : nullptr; }
+    const unsigned int *data() const { return &id; }
+private:
+    int len;
+    unsigned int id;
+    char name_buf[16];
+};
+
+} // namespace fast